@@ -0,0 +1,216 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+/* Benchmarks of the simulation phases
+ * - Every point of the grid (population x avgDailyInter by default, any option with -sweep) is simulated for
+ *   warmupDays days and the state of that day is the snapshot all repetitions start from
+ * - A repetition simulates the next day of a copy of the snapshot phase by phase, timing every phase, and then
+ *   the whole day of another copy; the first warmup repetitions are not counted
+ * - Random numbers depend only on the day, so every repetition does exactly the same work
+ * - One JSON object per point and phase is written per line with the median and the 99th percentile of the
+ *   repetitions in ns per day and ns per person, tagged with -label to compare runs of different commits */
+
+#define IMS_NO_MAIN
+#include "main.cpp"
+
+const char* const bench_phase_names[] = {"interactions", "home_quarantine", "illness", "hospital", "day"};
+const unsigned int n_of_bench_phases = 5;
+
+struct bench_settings_t {
+	unsigned int warmup_days = 20;
+	unsigned int warmup = 2;
+	unsigned int repetitions = 20;
+	string label, output_file;
+};
+
+enum bench_option_t { WARMUP_DAYS = 1000, WARMUP, REPETITIONS, LABEL, OUTPUT };
+
+// Nearest rank percentile of sorted samples
+double BenchPercentile(const vector<double>& sorted, double percent){
+	size_t rank = (size_t)ceil(percent / 100 * sorted.size());
+	return sorted[rank ? rank - 1 : 0];
+}
+
+/* Times the phases of the day after the snapshot
+ * - samples[phase] receives the ns of every counted repetition */
+template <class Model>
+void BenchPoint(const Model& snapshot, const bench_settings_t& bench, vector<vector<double>>& samples, double& sink){
+	typedef chrono::steady_clock clock;
+	auto elapsed = [](clock::time_point start){
+		return (double)chrono::duration_cast<chrono::nanoseconds>(clock::now() - start).count();
+	};
+
+	samples.assign(n_of_bench_phases, vector<double>());
+	for (unsigned int r = 0; r < bench.warmup + bench.repetitions; ++r) {
+		double ns[n_of_bench_phases];
+		Model population = snapshot;
+		++population.day;
+		clock::time_point start = clock::now();
+		population.CalculateInteractions();
+		ns[0] = elapsed(start);
+		start = clock::now();
+		population.HomeQuarantine();
+		ns[1] = elapsed(start);
+		start = clock::now();
+		population.IllnessAdvances();
+		ns[2] = elapsed(start);
+		start = clock::now();
+		population.Hospital();
+		ns[3] = elapsed(start);
+		sink += population.Series()[SICK];
+
+		Model day = snapshot;
+		start = clock::now();
+		day.AdvanceDay();
+		ns[4] = elapsed(start);
+		sink += day.Series()[SICK];
+
+		if (r < bench.warmup) continue;
+		for (unsigned int phase = 0; phase < n_of_bench_phases; ++phase) samples[phase].push_back(ns[phase]);
+	}
+}
+
+template <class Model>
+void BenchModel(Model population, const bench_settings_t& bench, vector<vector<double>>& samples, double& sink){
+	while (population.day < bench.warmup_days) population.AdvanceDay();
+	BenchPoint(population, bench, samples, sink);
+}
+
+int main(int argc, char* argv[]) {
+	settings_t base;
+	bench_settings_t bench;
+	vector<sweep_dimension_t> grid;
+
+	vector<option> opts(long_opts, long_opts + sizeof(long_opts) / sizeof(*long_opts) - 1);
+	opts.push_back({"warmupDays", required_argument, nullptr, WARMUP_DAYS});
+	opts.push_back({"warmup", required_argument, nullptr, WARMUP});
+	opts.push_back({"repetitions", required_argument, nullptr, REPETITIONS});
+	opts.push_back({"label", required_argument, nullptr, LABEL});
+	opts.push_back({"output", required_argument, nullptr, OUTPUT});
+	opts.push_back({nullptr, no_argument, nullptr, 0});
+
+	while (true)
+	{
+		const auto opt = getopt_long_only(argc, argv, "", opts.data(), nullptr);
+
+		if (opt == -1)
+			break;
+
+		try {
+			switch (opt)
+			{
+				case 'v':
+					grid.emplace_back();
+					if (!ParseSweep(optarg, grid.back())) {
+						cout << "Invalid sweep: " << optarg << endl;
+						return 1;
+					}
+					break;
+				case WARMUP_DAYS: bench.warmup_days = stoul(optarg); break;
+				case WARMUP: bench.warmup = stoul(optarg); break;
+				case REPETITIONS: bench.repetitions = max(stoul(optarg), 1ul); break;
+				case LABEL: bench.label = optarg; break;
+				case OUTPUT: bench.output_file = optarg; break;
+				case 'h':
+				case '?':
+					cout << "Usage: bench [options of main] [-sweep NAME=VALUES ...] [-warmupDays N] [-warmup N]" << endl
+						 << "             [-repetitions N] [-label TEXT] [-output FILE]" << endl
+						 << "  Without -sweep the grid is population=10000,...,10000000 x avgDailyInter=10,100,1000,5000," << endl
+						 << "  populations going up to 100000000 for the aggregate and deterministic engines," << endl
+						 << "  initSick and hospCap scale with the population in the proportion of the options" << endl;
+					return 0;
+				default:
+					if (!ApplyOption(base, opt, optarg ? optarg : "")) {
+						cout << "Invalid option value: " << (optarg ? optarg : "") << endl;
+						return 1;
+					}
+			}
+		}
+		catch (const logic_error&) {
+			cout << "Invalid option value: " << optarg << endl;
+			return 1;
+		}
+	}
+
+	// The continuous time engines have no daily phases to time
+	if (base.engine == engine_t::ssa || base.engine == engine_t::tau) {
+		cout << "The " << engine_names[(int)base.engine] << " engine can't be benchmarked by phases" << endl;
+		return 1;
+	}
+
+	if (grid.empty()) {
+		grid.resize(2);
+		// The engines going through every person would spend minutes on a day of 100000000 people
+		const bool per_person = base.engine == engine_t::individual || base.engine == engine_t::agent;
+		ParseSweep(per_person ? "population=10000,100000,1000000,10000000" : "population=10000,100000,1000000,10000000,100000000", grid[0]);
+		ParseSweep("avgDailyInter=10,100,1000,5000", grid[1]);
+	}
+
+	ofstream file;
+	if (!bench.output_file.empty()) {
+		file.open(bench.output_file);
+		if (!file.is_open()) {
+			cout << "Unable to open file";
+			return 1;
+		}
+	}
+	ostream& out = bench.output_file.empty() ? cout : file;
+
+	unsigned int n_of_points = 1;
+	for (const auto& dimension : grid) n_of_points *= dimension.values.size();
+
+	double sink = 0;
+	for (unsigned int p = 0; p < n_of_points; ++p) {
+		settings_t settings = base;
+		unsigned int point = p;
+		for (const auto& dimension : grid) {
+			ApplyOption(settings, dimension.opt, dimension.values[point % dimension.values.size()]);
+			point /= dimension.values.size();
+		}
+		if (settings.total_population != base.total_population) {
+			const double scale = (double)settings.total_population / base.total_population;
+			settings.initial_number_of_sick = max(1u, (unsigned int)(base.initial_number_of_sick * scale));
+			settings.hospital_capacity = (unsigned int)(base.hospital_capacity * scale);
+		}
+
+		vector<vector<double>> samples;
+		switch (settings.engine) {
+			case engine_t::deterministic: BenchModel(NewMeanFieldPopulation(settings), bench, samples, sink); break;
+			case engine_t::agent: BenchModel(NewAgentPopulation(settings, 0), bench, samples, sink); break;
+			default: BenchModel(NewPopulation(settings, 0), bench, samples, sink);
+		}
+
+		for (unsigned int phase = 0; phase < n_of_bench_phases; ++phase) {
+			vector<double>& ns = samples[phase];
+			sort(ns.begin(), ns.end());
+			const double median = BenchPercentile(ns, 50), p99 = BenchPercentile(ns, 99);
+			out << fixed << setprecision(3)
+				<< "{\"label\":\"" << bench.label << "\",\"engine\":\"" << engine_names[(int)settings.engine] << "\"";
+			out << ",\"point\":{";
+			point = p;
+			for (size_t d = 0; d < grid.size(); ++d) {
+				out << (d ? "," : "") << "\"" << grid[d].name << "\":\"" << grid[d].values[point % grid[d].values.size()] << "\"";
+				point /= grid[d].values.size();
+			}
+			out << "},\"population\":" << settings.total_population
+				<< ",\"avgDailyInter\":" << settings.average_daily_interactions
+				<< ",\"day\":" << bench.warmup_days + 1
+				<< ",\"phase\":\"" << bench_phase_names[phase] << "\""
+				<< ",\"repetitions\":" << ns.size()
+				<< ",\"median_ns_per_day\":" << median
+				<< ",\"p99_ns_per_day\":" << p99
+				<< ",\"median_ns_per_person\":" << median / settings.total_population
+				<< ",\"p99_ns_per_person\":" << p99 / settings.total_population
+				<< "}\n";
+		}
+		out.flush();
+	}
+	// Keeps the simulated days from being optimized away
+	if (sink < 0) cout << sink << endl;
+	return 0;
+}
@@ -0,0 +1,142 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_CHECKPOINT_H
+#define IMS_CHECKPOINT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "residence.h"
+#include "timeseries.h"
+
+/* Binary snapshots of the simulation state
+ * - A class makes itself checkpointable with a template <class Archive> void Checkpoint(Archive&) method listing
+ *   its fields through archive.Value(), the same method then both saves and restores them
+ * - Values are stored in native byte order, vectors and histograms are prefixed by their length
+ * - Random numbers need no state of their own: streams are derived from (seed, replicate, day, phase),
+ *   which the snapshot already holds, so a restored run draws exactly the numbers the original would have */
+
+const char checkpoint_magic[8] = {'I', 'M', 'S', 'C', 'H', 'K', 'P', 'T'};
+const uint32_t checkpoint_version = 6;
+
+/* Saves values into a snapshot file
+ * - The file is written under a temporary name and renamed when complete, so an interrupted save
+ *   leaves the previous snapshot intact */
+class CheckpointWriter {
+public:
+	bool Open(const std::string& filename){
+		this->filename = filename;
+		this->file.open(filename + ".tmp", std::ios::binary | std::ios::trunc);
+		if (!this->file.is_open()) return false;
+		this->file.write(checkpoint_magic, sizeof(checkpoint_magic));
+		this->Value(checkpoint_version);
+		return (bool)this->file;
+	}
+
+	template <class T>
+	void Value(const T& value){
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written directly");
+		this->file.write((const char*)&value, sizeof(T));
+	}
+	template <class T>
+	void Value(const std::vector<T>& values){
+		this->Value((uint64_t)values.size());
+		for (const T& value : values) this->Value(value);
+	}
+	template <class T>
+	void Value(const ResidenceHistogram<T>& histogram){
+		this->Value((uint32_t)histogram.Days());
+		for (unsigned int days = 0; days < histogram.Days(); ++days) this->Value(histogram[days]);
+	}
+	void Value(const TimeSeriesStore& store){
+		this->Value((uint32_t)store.Metrics());
+		this->Value((uint32_t)store.Days());
+		for (unsigned int m = 0; m < store.Metrics(); ++m) {
+			const column_view_t column = store.Column(m);
+			this->file.write((const char*)column.begin(), column.size() * sizeof(double));
+		}
+	}
+
+	// Finishes the snapshot and puts it in place of the previous one
+	bool Close(){
+		this->file.close();
+		if (!this->file) return false;
+		return std::rename((this->filename + ".tmp").c_str(), this->filename.c_str()) == 0;
+	}
+
+private:
+	std::string filename;
+	std::ofstream file;
+};
+
+/* Restores values from a snapshot file in the order they were saved
+ * - Good() turns false on a truncated or foreign file and stays false */
+class CheckpointReader {
+public:
+	bool Open(const std::string& filename){
+		this->file.open(filename, std::ios::binary);
+		char magic[sizeof(checkpoint_magic)];
+		uint32_t version = 0;
+		this->file.read(magic, sizeof(magic));
+		this->Value(version);
+		return this->Good() && std::equal(magic, magic + sizeof(magic), checkpoint_magic) && version == checkpoint_version;
+	}
+
+	bool Good() const { return (bool)this->file; }
+
+	template <class T>
+	void Value(T& value){
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read directly");
+		this->file.read((char*)&value, sizeof(T));
+	}
+	template <class T>
+	void Value(std::vector<T>& values){
+		uint64_t size = 0;
+		this->Value(size);
+		values.clear();
+		for (uint64_t i = 0; i < size && this->Good(); ++i) {
+			values.emplace_back();
+			this->Value(values.back());
+		}
+	}
+	template <class T>
+	void Value(ResidenceHistogram<T>& histogram){
+		uint32_t n_of_days = 0;
+		this->Value(n_of_days);
+		histogram = ResidenceHistogram<T>(n_of_days);
+		for (unsigned int days = 0; days < n_of_days && this->Good(); ++days) this->Value(histogram[days]);
+	}
+	void Value(TimeSeriesStore& store){
+		uint32_t n_of_metrics = 0, n_of_days = 0;
+		this->Value(n_of_metrics);
+		this->Value(n_of_days);
+		if (!this->Good() || n_of_metrics != store.Metrics()) {
+			this->file.setstate(std::ios::failbit);
+			return;
+		}
+		std::vector<double> columns((size_t)n_of_metrics * n_of_days);
+		this->file.read((char*)columns.data(), columns.size() * sizeof(double));
+		store.Clear();
+		std::vector<double> day(n_of_metrics);
+		for (unsigned int d = 0; d < n_of_days; ++d) {
+			for (unsigned int m = 0; m < n_of_metrics; ++m) day[m] = columns[(size_t)m * n_of_days + d];
+			store.Append(day);
+		}
+	}
+
+private:
+	std::ifstream file;
+};
+
+#endif //IMS_CHECKPOINT_H
@@ -0,0 +1,210 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_EVENTS_H
+#define IMS_EVENTS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "rng.h"
+
+/* Structured event trace
+ * - Every event is a fixed size binary record: the day, phase and type of the event, who it happened to
+ *   (replicate, region) and the counters involved (number of people, interaction circle or day of stay)
+ * - Each thread writes into its own ring buffer keeping the latest events, so recording takes no locks
+ * - Recording can be sampled, keeping one of every N events of a thread
+ * - The rings are dumped into a binary file when the program finishes and RenderEvents() turns one into text
+ * - Models record through the EVENT macro, which compiles to nothing for the phases their Trace policy
+ *   does not record (see trace.h), and the events are only kept after EventLog::Enable() */
+
+enum class event_type_t : uint8_t {
+	infection,          // count got infected in interaction circle detail
+	staying_home,       // count healthy people went home after meeting an infectious person in circle detail
+	recovery,           // count recovered (detail = day of the hospital stay, 0 outside of the hospital)
+	death,              // count died on day detail of their hospital stay
+	waiting_for_bed,    // count started waiting for a hospital bed
+	admission,          // count were admitted after waiting detail days
+	mild_symptoms,      // count developed mild symptoms, detail of them stay at home
+	severe_symptoms,    // count developed severe symptoms
+	step_up             // count moved from a ward bed into intensive care on day detail of their ward stay
+};
+const unsigned int n_of_event_types = 9, n_of_event_phases = 7;
+const char* const event_type_names[n_of_event_types] = {"infection", "staying_home", "recovery", "death", "waiting_for_bed",
+														"admission", "mild_symptoms", "severe_symptoms", "step_up"};
+// Indexed by phase_t, prefixes of the matching TRACE output
+const char* const event_phase_prefixes[n_of_event_phases] = {"S|", "I|", "Q|", "A|", "H|", "M|", "R|"};
+
+struct event_t {
+	uint32_t day;
+	uint32_t replicate;
+	uint32_t count;
+	uint32_t detail;
+	uint16_t region;
+	uint8_t phase;
+	event_type_t type;
+};
+static_assert(sizeof(event_t) == 20, "Event records are stored as they are");
+
+struct event_file_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	// Events in the file and events recorded before sampling and overwriting
+	uint64_t n_of_events, n_of_seen;
+};
+
+const char event_file_magic[8] = {'I', 'M', 'S', 'E', 'V', 'E', 'N', 'T'};
+const uint32_t event_file_version = 1;
+
+/* Latest events recorded by one thread, older ones are overwritten */
+class EventRing {
+public:
+	EventRing(size_t capacity, uint32_t sample_every)
+		: events(capacity ? capacity : 1), sample_every(sample_every ? sample_every : 1) {}
+
+	void Record(const event_t& event){
+		if (++this->seen % this->sample_every != 0) return;
+		this->events[this->recorded % this->events.size()] = event;
+		++this->recorded;
+	}
+
+	// Appends the kept events, oldest first
+	void CopyTo(std::vector<event_t>& out) const{
+		const uint64_t kept = std::min<uint64_t>(this->recorded, this->events.size());
+		for (uint64_t i = this->recorded - kept; i < this->recorded; ++i) {
+			out.push_back(this->events[i % this->events.size()]);
+		}
+	}
+
+	uint64_t Seen() const { return this->seen; }
+
+private:
+	std::vector<event_t> events;
+	uint32_t sample_every;
+	uint64_t seen = 0, recorded = 0;
+};
+
+/* All rings of the process, a ring outlives its thread so the events of finished workers can still be dumped */
+class EventLog {
+public:
+	// Starts recording with the given ring size (events per thread) and sampling
+	static void Enable(size_t ring_capacity, uint32_t sample_every){
+		EventLog& log = Instance();
+		log.ring_capacity = ring_capacity;
+		log.sample_every = sample_every;
+		log.enabled.store(true, std::memory_order_release);
+	}
+
+	static void Record(phase_t phase, event_type_t type, uint32_t day, uint32_t replicate, uint16_t region,
+					   uint32_t count, uint32_t detail = 0){
+		if (count == 0 || !Instance().enabled.load(std::memory_order_relaxed)) return;
+		thread_local EventRing* ring = nullptr;
+		if (!ring) ring = Instance().NewRing();
+		event_t event;
+		event.day = day;
+		event.replicate = replicate;
+		event.count = count;
+		event.detail = detail;
+		event.region = region;
+		event.phase = (uint8_t)phase;
+		event.type = type;
+		ring->Record(event);
+	}
+
+	/* Writes the events of all rings into a binary file
+	 * - Must not run while other threads still record */
+	static bool Dump(const std::string& filename){
+		EventLog& log = Instance();
+		std::vector<event_t> events;
+		uint64_t seen = 0;
+		{
+			std::lock_guard<std::mutex> guard(log.lock);
+			for (const auto& ring : log.rings) {
+				ring->CopyTo(events);
+				seen += ring->Seen();
+			}
+		}
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+		event_file_header_t header;
+		memcpy(header.magic, event_file_magic, sizeof(header.magic));
+		header.version = event_file_version;
+		header.record_size = sizeof(event_t);
+		header.n_of_events = events.size();
+		header.n_of_seen = seen;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)events.data(), events.size() * sizeof(event_t));
+		return (bool)file;
+	}
+
+	// Dumps the events into the file when the program exits
+	static void DumpAtExit(const std::string& filename){
+		Instance().exit_file = filename;
+		std::atexit([]{ Dump(Instance().exit_file); });
+	}
+
+private:
+	std::atomic<bool> enabled{false};
+	size_t ring_capacity = 0;
+	uint32_t sample_every = 1;
+	std::mutex lock;
+	std::vector<std::unique_ptr<EventRing>> rings;
+	std::string exit_file;
+
+	static EventLog& Instance(){
+		static EventLog log;
+		return log;
+	}
+
+	EventRing* NewRing(){
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->rings.emplace_back(new EventRing(this->ring_capacity, this->sample_every));
+		return this->rings.back().get();
+	}
+};
+
+/* Renders a file written by EventLog::Dump() as one line of text per event
+ * - Returns false when the file is not an event file */
+inline bool RenderEvents(const std::string& filename, std::ostream& out){
+	std::ifstream file(filename, std::ios::binary);
+	event_file_header_t header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(header.magic, event_file_magic, sizeof(header.magic)) != 0
+			|| header.version != event_file_version || header.record_size != sizeof(event_t)) return false;
+
+	out << "# " << header.n_of_events << " events kept of " << header.n_of_seen << " recorded\n";
+	out << "# Day Replicate Region Phase Event Count Detail\n";
+	event_t event;
+	for (uint64_t i = 0; i < header.n_of_events; ++i) {
+		if (!file.read((char*)&event, sizeof(event))) return false;
+		if (event.phase >= n_of_event_phases || (unsigned int)event.type >= n_of_event_types) return false;
+		out << event.day << " " << event.replicate << " " << event.region << " " << event_phase_prefixes[event.phase]
+			<< " " << event_type_names[(unsigned int)event.type] << " " << event.count << " " << event.detail << "\n";
+	}
+	return true;
+}
+
+/* Records an event of the current day of the enclosing model when its Tracing policy records the phase
+ * - The model provides the day, replicate and region members */
+#define EVENT(phase, type, count, detail) do { \
+  if constexpr (Tracing::Records(phase)) { \
+    EventLog::Record(phase, type, this->day, this->replicate, this->region, count, detail); \
+  } \
+} while (0)
+
+#endif //IMS_EVENTS_H
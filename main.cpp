@@ -10,15 +10,33 @@
 #include <random>
 #include <getopt.h>
 #include <fstream>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <tuple>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+
+#include "rng.h"
+#include "trace.h"
+#include "events.h"
+#include "sampling.h"
+#include "thread_pool.h"
+#include "residence.h"
+#include "timeseries.h"
+#include "series_file.h"
+#include "spsc_queue.h"
+#include "checkpoint.h"
+#include "metrics.h"
+#include "reaction_network.h"
 
 using namespace std;
 
-bool debugging_enabled = false;
-#define DEBUG(msg) do { \
-  if (debugging_enabled) { msg } \
-} while (0)
-
-unsigned int* incubating;
 
 struct probabilities_t {
 	float getting_sick = 0.0;
@@ -31,15 +49,135 @@ struct probabilities_t {
 	float home_recovery = 0.0;
 
 	float post_recovery_paranoia = 0.5;
-} probability_of;
 
-// Returns 0.0001 (0.01%) to 1.0 (100%)
-float percentageFraction(){
-   return (float)(min(rand() % 10001, 10000))/(float)10000;
-}
+	// Hospital chances by the number of days already spent in a bed, the last one also applies to longer stays
+	// (when empty, hospital_recovery and hospital_death apply regardless of the length of stay)
+	vector<float> hospital_recovery_by_day, hospital_death_by_day;
+
+	// Number of days of a hospital stay with their own chances
+	unsigned int HospitalDays() const{
+		return max<size_t>(max(hospital_recovery_by_day.size(), hospital_death_by_day.size()), 1);
+	}
+	float HospitalRecovery(unsigned int days) const{
+		if (hospital_recovery_by_day.empty()) return hospital_recovery;
+		return hospital_recovery_by_day[min<size_t>(days, hospital_recovery_by_day.size() - 1)];
+	}
+	float HospitalDeath(unsigned int days) const{
+		if (hospital_death_by_day.empty()) return hospital_death;
+		return hospital_death_by_day[min<size_t>(days, hospital_death_by_day.size() - 1)];
+	}
+
+	// Intensive care tier: chance of a ward patient to need intensive care by their day in the ward and the chances
+	// of recovery and death in intensive care by the day spent there, the last one also applies to longer stays
+	vector<float> icu_step_up_by_day, icu_recovery_by_day, icu_death_by_day;
+
+	// Number of days of an intensive care stay with their own chances
+	unsigned int IcuDays() const{
+		return max<size_t>(max(icu_recovery_by_day.size(), icu_death_by_day.size()), 1);
+	}
+	float IcuStepUp(unsigned int days) const{
+		return ByDay(icu_step_up_by_day, days);
+	}
+	float IcuRecovery(unsigned int days) const{
+		return ByDay(icu_recovery_by_day, days);
+	}
+	float IcuDeath(unsigned int days) const{
+		return ByDay(icu_death_by_day, days);
+	}
+
+	template <class Archive>
+	void Checkpoint(Archive& archive){
+		archive.Value(getting_sick);
+		archive.Value(healthy_staying_home);
+		archive.Value(mild_symptoms);
+		archive.Value(ms_staying_home);
+		archive.Value(hospital_recovery);
+		archive.Value(hospital_death);
+		archive.Value(home_recovery);
+		archive.Value(post_recovery_paranoia);
+		archive.Value(hospital_recovery_by_day);
+		archive.Value(hospital_death_by_day);
+		archive.Value(icu_step_up_by_day);
+		archive.Value(icu_recovery_by_day);
+		archive.Value(icu_death_by_day);
+	}
+
+private:
+	static float ByDay(const vector<float>& chances, unsigned int days){
+		if (chances.empty()) return 0.0;
+		return chances[min<size_t>(days, chances.size() - 1)];
+	}
+};
+
+/* Integer thresholds precomputed from probabilities_t for RandomStream::Bernoulli
+ * - Hospital outcomes share one draw, so the death threshold is cumulative with the recovery one */
+struct thresholds_t {
+	uint64_t getting_sick = 0;
+	uint64_t healthy_staying_home = 0;
+	uint64_t mild_symptoms = 0;
+	uint64_t ms_staying_home = 0;
+
+	uint64_t hospital_recovery = 0;
+	uint64_t hospital_recovery_or_death = 0;
+	uint64_t home_recovery = 0;
+
+	uint64_t post_recovery_paranoia = 0;
+
+	// Hospital outcomes by the number of days already spent in a bed, see probabilities_t::HospitalDays()
+	vector<uint64_t> hospital_recovery_by_day, hospital_recovery_or_death_by_day;
+
+	thresholds_t() = default;
+	explicit thresholds_t(const probabilities_t& probability){
+		this->getting_sick = Threshold(probability.getting_sick);
+		this->healthy_staying_home = Threshold(probability.healthy_staying_home);
+		this->mild_symptoms = Threshold(probability.mild_symptoms);
+		this->ms_staying_home = Threshold(probability.ms_staying_home);
+		this->hospital_recovery = Threshold(probability.hospital_recovery);
+		this->hospital_recovery_or_death = Threshold((double)probability.hospital_recovery + probability.hospital_death);
+		this->home_recovery = Threshold(probability.home_recovery);
+		this->post_recovery_paranoia = Threshold(probability.post_recovery_paranoia);
+		for (unsigned int days = 0; days < probability.HospitalDays(); ++days) {
+			this->hospital_recovery_by_day.push_back(Threshold(probability.HospitalRecovery(days)));
+			this->hospital_recovery_or_death_by_day.push_back(
+				Threshold((double)probability.HospitalRecovery(days) + probability.HospitalDeath(days)));
+		}
+	}
+};
+
+/* How the population is advanced each day
+ * - individual: every person in a compartment gets their own dice roll (reference mode)
+ * - aggregate: every compartment's outflows are drawn at once from a binomial or multinomial distribution
+ * - deterministic: compartments hold the expected number of people and advance by their expected outflows
+ * - agent: every person is an agent with their own state, days in that state, whereabouts and hospital bed
+ * - ssa: exact continuous time simulation of the compartments event by event, reported at the end of every day
+ * - tau: the continuous time model of ssa advanced in adaptive leaps of many events, exact only where counts are low */
+enum class engine_t { individual, aggregate, deterministic, agent, ssa, tau };
+const char* const engine_names[] = {"individual", "aggregate", "deterministic", "agent", "ssa", "tau"};
+
+// Columns of data.dat that follow the day number
+enum series_t { SICK, DEAD, HEALTHY, ASYMPTOMATIC, MILDLY_SYMPTOMATIC, SEVERELY_SYMPTOMATIC, N_OF_SERIES };
+const char* const series_names[N_OF_SERIES] = {"Sick", "Dead", "Healthy", "Asymptomatic", "Mildly_symptomatic", "Severely_symptomatic"};
+typedef array<double, N_OF_SERIES> series_values_t;
+
+/* Limits of the substream keying the random stream of an interaction pool
+ * - CounterStream leaves the substream 24 bits next to the phase: bits 0-15 hold the region,
+ *   bits 16-23 the pool + 1 (0 being the stream of the region itself) */
+const unsigned int max_interaction_pools = 255, max_regions = 1 << 16;
+
+// Parameters of one day of a run following a schedule
+struct day_parameters_t {
+	probabilities_t probability_of;
+	unsigned int average_daily_interactions = 0, hospital_capacity = 0;
+	// Something differs from the day before, so the day has to be applied
+	bool changed = false;
+};
 
-class Population {
+template <class Tracing>
+class BasicPopulation {
 public:
+	// Waits for a hospital bed longer than this are counted together
+	static constexpr unsigned int tracked_waiting_days = 28;
+
 	unsigned int day;
 	unsigned int total_population, incubation_period, is_infectious_since_day, average_daily_interactions, dead;
 	unsigned int healthy_at_home, healthy_in_public;
@@ -47,8 +185,36 @@ public:
 	unsigned int ms_at_home, ms_in_public;
 	unsigned int ss_waiting_for_bed, ss_in_bed;
 	unsigned int available_hospital_beds;
-
-	Population(unsigned int total_population,
+	// Number of people on each day of the incubation period who are still in public
+	ResidenceHistogram<unsigned int> incubating;
+	// ss_waiting_for_bed and ss_in_bed by the number of days spent waiting or in a bed
+	ResidenceHistogram<unsigned int> ss_waiting_by_day, ss_in_bed_by_day;
+	probabilities_t probability_of;
+	thresholds_t threshold_of;
+	// Random draws and events so far, for the metrics
+	phase_counters_t counted;
+	engine_t engine = engine_t::individual;
+	uint64_t seed = 0;
+	unsigned int replicate = 0;
+	unsigned int region = 0;
+	// Infectious people of other regions mixing into today's interaction circles and residents mixing elsewhere
+	// (set by Metapopulation before the interactions, zero for a single region)
+	unsigned int visiting_infectious = 0, visiting_mildly_infectious = 0;
+	unsigned int away_infectious = 0, away_mildly_infectious = 0;
+	// Pools the interactions are split into (1 keeps them in one serial pass) and the threads forming them
+	unsigned int interaction_pools = 1, interaction_threads = 0;
+	// Threads forming the pools, kept for the whole run
+	LazyWorkerPool interaction_workers;
+	// Draws the outcome of the interactions in closed form instead of forming the circles
+	bool closed_form_interactions = false;
+	// Occupied ward beds that close when their patients leave, after the capacity was lowered
+	unsigned int closing_hospital_beds = 0;
+	// Intensive care tier of the hospitals, without beds all patients stay in the ward
+	unsigned int icu_capacity = 0, icu_patients = 0, available_icu_beds = 0;
+	// icu_patients by the number of days spent in intensive care
+	ResidenceHistogram<unsigned int> icu_by_day;
+
+	BasicPopulation(unsigned int total_population,
 				unsigned int incubation_period,
 				unsigned int initial_number_of_sick,
 				unsigned int is_infectious_since_day,
@@ -67,31 +233,100 @@ public:
 		this->healthy_in_public = total_population - initial_number_of_sick;
 		this->available_hospital_beds = number_of_hospital_beds;
 		this->asymptomatic_in_public = initial_number_of_sick;
+		this->incubating = ResidenceHistogram<unsigned int>(incubation_period);
+		if (incubation_period) this->incubating[0] = initial_number_of_sick;
+		this->ss_waiting_by_day = ResidenceHistogram<unsigned int>(tracked_waiting_days);
+		this->ss_in_bed_by_day = ResidenceHistogram<unsigned int>(this->probability_of.HospitalDays());
+	}
+
+	// Sets the chances used from now on together with their precomputed thresholds
+	void SetProbabilities(const probabilities_t& probabilities){
+		this->probability_of = probabilities;
+		this->threshold_of = thresholds_t(probabilities);
+		// Stays only need to be told apart as long as their chances differ
+		this->ss_in_bed_by_day.Resize(probabilities.HospitalDays());
+		this->icu_by_day.Resize(probabilities.IcuDays());
+	}
+
+	/* Changes the number of ward beds
+	 * - Occupied beds beyond a lower capacity close as their patients leave */
+	void SetHospitalCapacity(unsigned int number_of_hospital_beds){
+		const int64_t change = (int64_t)number_of_hospital_beds
+							 - ((int64_t)this->ss_in_bed + this->available_hospital_beds - this->closing_hospital_beds);
+		if (change >= 0) {
+			const unsigned int reopened = min<int64_t>(this->closing_hospital_beds, change);
+			this->closing_hospital_beds -= reopened;
+			this->available_hospital_beds += change - reopened;
+		}
+		else {
+			const unsigned int removed = min<int64_t>(this->available_hospital_beds, -change);
+			this->available_hospital_beds -= removed;
+			this->closing_hospital_beds += -change - removed;
+		}
+	}
+
+	// Parameters of a day of a schedule, see Schedule
+	void ApplyParameters(const day_parameters_t& parameters){
+		this->SetProbabilities(parameters.probability_of);
+		this->average_daily_interactions = parameters.average_daily_interactions;
+		this->SetHospitalCapacity(parameters.hospital_capacity);
+	}
+
+	// Gives the hospitals the given number of intensive care beds on top of the ward beds
+	void SetIntensiveCare(unsigned int number_of_icu_beds){
+		this->icu_capacity = number_of_icu_beds;
+		this->available_icu_beds = number_of_icu_beds - min(this->icu_patients, number_of_icu_beds);
+	}
+
+	// People who from today wait for a hospital bed
+	void StartWaitingForBed(unsigned int patients){
+		this->ss_waiting_for_bed += patients;
+		this->ss_waiting_by_day[0] += patients;
+	}
+
+	// People in public who are infectious, but don't know it yet (still within incubation period)
+	unsigned int IncubatingInfectious() const{
+		unsigned int infectious = 0;
+		for (unsigned int i = this->is_infectious_since_day; i <= this->incubation_period; i++){
+			infectious += this->incubating[i];
+		}
+		return infectious;
+	}
+
+	// Random numbers for the given phase of the current day
+	RandomStream Stream(phase_t phase) const {
+		return RandomStream(this->seed, this->replicate, this->day, phase, this->region);
 	}
 
 	/* Simulates the spread of infection between people in public
 	 * - Gets all the people moving around the public and randomly composes groups simulating encounters
 	 * - If an infectious person is in the group all the healthy people have a chance to catch the disease */
-	void CalculateInteractions(bool local_debug_out_enabled = false) {
-		local_debug_out_enabled ? debugging_enabled = true : debugging_enabled = false;
+	void CalculateInteractions() {
+		if (this->closed_form_interactions) { ClosedFormCalculateInteractions(); return; }
+		if (this->interaction_pools > 1) { PartitionedCalculateInteractions(); return; }
+		if (this->engine == engine_t::aggregate) { AggregateCalculateInteractions(); return; }
+		RandomStream rng = this->Stream(phase_t::interactions);
 
 		unsigned int available, available_infectious, available_mildly_infectious, present_infectious, present_healthy, picked_person, x;
 		available = available_infectious = available_mildly_infectious = present_infectious = present_healthy = picked_person = x = 0;
+		const unsigned int asymptomatic_before = this->asymptomatic_at_home + this->asymptomatic_in_public;
+		unsigned int groups = 0;
 
-		DEBUG(cout << "Infection spreading events: " << endl;);
+		TRACE(phase_t::interactions, cout << "Infection spreading events: " << endl;);
 		// Get people that are infectious, but don't know it yet (still within incubation period)
 		for (unsigned int i = this->is_infectious_since_day; i <= this->incubation_period; i++){
-			available_infectious += incubating[i];
-			DEBUG(cout << "I|  Incubated for " << i+1 << " days: " << incubating[i] << endl;);
+			available_infectious += this->incubating[i];
+			TRACE(phase_t::interactions, cout << "I|  Incubated for " << i+1 << " days: " << this->incubating[i] << endl;);
 		}
+		available_infectious = available_infectious - this->away_infectious + this->visiting_infectious;
 		// Get people knowingly going around sick
-		available_mildly_infectious = this->ms_in_public;
+		available_mildly_infectious = this->ms_in_public - this->away_mildly_infectious + this->visiting_mildly_infectious;
 		// Get the total number of people in this interaction circle
 		available = this->healthy_in_public + available_infectious + available_mildly_infectious;
 
-		DEBUG(cout << "I| Infectious in incubation: " << available_infectious << endl;);
-		DEBUG(cout << "I| Mildly infectious: " << available_mildly_infectious << endl;);
-		DEBUG(cout << "I| Available people: " << available << " of which " << this->healthy_in_public << " are healthy." << endl;);
+		TRACE(phase_t::interactions, cout << "I| Infectious in incubation: " << available_infectious << endl;);
+		TRACE(phase_t::interactions, cout << "I| Mildly infectious: " << available_mildly_infectious << endl;);
+		TRACE(phase_t::interactions, cout << "I| Available people: " << available << " of which " << this->healthy_in_public << " are healthy." << endl;);
 
 		while (available) {
 
@@ -99,244 +334,705 @@ public:
 			if ((available - (available_infectious + available_mildly_infectious)) != 0
 					&& (available_infectious + available_mildly_infectious) != 0) {
 				present_healthy = present_infectious = 0;
+				++groups;
 
 				// Pick a random combination of healthy and sick
 				for (unsigned int i = 0; i < this->average_daily_interactions && available != 0; i++) {
-					picked_person = rand() % available + 1;
+					picked_person = rng.Below(available) + 1;
 					if (picked_person <= available_infectious) {
 						--available;
 						--available_infectious;
 						++present_infectious;
-						DEBUG(cout << "I|  Picked a person number " << picked_person << " of " << available+1 << " that is infectious." << endl;);
+						TRACE(phase_t::interactions, cout << "I|  Picked a person number " << picked_person << " of " << available+1 << " that is infectious." << endl;);
 					}
 					else if (available_infectious < picked_person && picked_person < (available_infectious + available_mildly_infectious)){
 						--available;
 						--available_mildly_infectious;
 						++present_infectious;
-						DEBUG(cout << available_infectious << " " << picked_person << " " << (available_infectious + available_mildly_infectious) << endl;);
-						DEBUG(cout << "I|  Picked a person number " << picked_person << " of " << available+1 << " that is mildly infectious." << endl;);
+						TRACE(phase_t::interactions, cout << available_infectious << " " << picked_person << " " << (available_infectious + available_mildly_infectious) << endl;);
+						TRACE(phase_t::interactions, cout << "I|  Picked a person number " << picked_person << " of " << available+1 << " that is mildly infectious." << endl;);
 					}
 					else {
 						--available;
 						++present_healthy;
-						DEBUG(cout << "I|  Picked a person number " << picked_person << " of " << available+1 << " that is healthy." << endl;);
+						TRACE(phase_t::interactions, cout << "I|  Picked a person number " << picked_person << " of " << available+1 << " that is healthy." << endl;);
 					}
 				}
 
-				DEBUG(cout << "I| (" << x << ") | Present healthy: " << present_healthy << " | Present infectious: " << present_infectious << " | " << endl;);
+				TRACE(phase_t::interactions, cout << "I| (" << x << ") | Present healthy: " << present_healthy << " | Present infectious: " << present_infectious << " | " << endl;);
 
 				// If interaction with at least one infectious person happened
 				if (present_infectious) {
 					// have a chance to affect all healthy people
 					while (present_healthy) {
-						if (percentageFraction() <= probability_of.getting_sick) {
-							DEBUG(cout << "I|   - Became asymptomatic";);
-							if (percentageFraction() <= probability_of.healthy_staying_home) {
+						if (rng.Bernoulli(threshold_of.getting_sick)) {
+							TRACE(phase_t::interactions, cout << "I|   - Became asymptomatic";);
+							EVENT(phase_t::interactions, event_type_t::infection, 1, x);
+							if (rng.Bernoulli(threshold_of.healthy_staying_home)) {
 								--this->healthy_in_public;
 								++this->asymptomatic_at_home;
-								DEBUG(cout << " and is going home" << endl;);
+								TRACE(phase_t::interactions, cout << " and is going home" << endl;);
 							}
 							else{
 								--this->healthy_in_public;
 								++this->asymptomatic_in_public;
-								++incubating[0];
-								DEBUG(cout << " and is staying in public and incubating" << endl;);
+								++this->incubating[0];
+								TRACE(phase_t::interactions, cout << " and is staying in public and incubating" << endl;);
 							}
 						}
 						else {
 							// If they get scared after finding out that
-							if (percentageFraction() <= probability_of.healthy_staying_home) {
+							if (rng.Bernoulli(threshold_of.healthy_staying_home)) {
 								--this->healthy_in_public;
 								++this->healthy_at_home;
-								DEBUG(cout << "I|   - Healthy going home" << endl;);
+								EVENT(phase_t::interactions, event_type_t::staying_home, 1, x);
+								TRACE(phase_t::interactions, cout << "I|   - Healthy going home" << endl;);
 							}
 							else{
-								DEBUG(cout << "I|   - Healthy staying in public" << endl;);
+								TRACE(phase_t::interactions, cout << "I|   - Healthy staying in public" << endl;);
 							}
 						}
 						--present_healthy;
 					}
 				}
-				DEBUG(cout << "I| -- Unevaluated people left: " << available << " of which healthy: " << available - (available_infectious + available_mildly_infectious) + 1 << " --" << endl;);
+				TRACE(phase_t::interactions, cout << "I| -- Unevaluated people left: " << available << " of which healthy: " << available - (available_infectious + available_mildly_infectious) + 1 << " --" << endl;);
 			}
 			else { available = 0; }
 			++x;
 		}
 
-		DEBUG(cout << " \\----------------" << endl;);
-		local_debug_out_enabled ? debugging_enabled = false : debugging_enabled = true;
+		this->counted.draws += rng.Draws();
+		this->counted.groups += groups;
+		this->counted.infections += this->asymptomatic_at_home + this->asymptomatic_in_public - asymptomatic_before;
+		TRACE(phase_t::interactions, cout << " \\----------------" << endl;);
 	}
 
 	/* Hospitals take action
-	 * - Cure, lose or keep each patient for another day of treatment
+	 * - Cure, lose or keep each patient for another day of treatment, with the chances of their day of stay
 	 * - Cured and lost patients free up beds
 	 * - Admit people from ss_waiting_for_bed until the capacity is filled */
-	void Hospital(bool local_debug_out_enabled = false){
-		local_debug_out_enabled ? debugging_enabled = true : debugging_enabled = false;
-		DEBUG(cout << "Hospital events: " << endl;);
+	void Hospital(){
+		if (this->engine == engine_t::aggregate) { AggregateHospital(); return; }
+		RandomStream rng = this->Stream(phase_t::hospital);
+		const unsigned int dead_before = this->dead;
+		TRACE(phase_t::hospital, cout << "Hospital events: " << endl;);
 
-		DEBUG(cout << "H| Start evaluating patients:" << endl;);
+		TRACE(phase_t::hospital, cout << "H| Start evaluating patients:" << endl;);
 		// Attempt to release patients to increase intake capacity
-		for (unsigned int i = 1; i <= this->ss_in_bed; i++) {
-			float patients_fate = percentageFraction();
-
-			DEBUG(cout << "H|  - Patient " << i;);
-			// Patient recovers
-			if(patients_fate <= probability_of.hospital_recovery){
-				++this->available_hospital_beds;
-				--this->ss_in_bed;
-				DEBUG(cout << " has recovered and ";);
-				// The recovered patient is paranoid and goes home until this ends
-				if(percentageFraction() <= probability_of.post_recovery_paranoia){
-					++this->healthy_at_home;
-					DEBUG(cout << "has post recovery paranoia (Self quarantine)." << endl;);
+		for (unsigned int days = 0; days < this->ss_in_bed_by_day.Days(); ++days) {
+			const uint64_t recovery = threshold_of.hospital_recovery_by_day[days];
+			const uint64_t recovery_or_death = threshold_of.hospital_recovery_or_death_by_day[days];
+			const unsigned int patients = this->ss_in_bed_by_day[days];
+			for (unsigned int i = 1; i <= patients; i++) {
+				uint32_t patients_fate = rng();
+
+				TRACE(phase_t::hospital, cout << "H|  - Patient " << i << " (day " << days + 1 << " in bed)";);
+				// Patient recovers
+				if(patients_fate < recovery){
+					++this->available_hospital_beds;
+					--this->ss_in_bed;
+					--this->ss_in_bed_by_day[days];
+					EVENT(phase_t::hospital, event_type_t::recovery, 1, days + 1);
+					TRACE(phase_t::hospital, cout << " has recovered and ";);
+					// The recovered patient is paranoid and goes home until this ends
+					if(rng.Bernoulli(threshold_of.post_recovery_paranoia)){
+						++this->healthy_at_home;
+						TRACE(phase_t::hospital, cout << "has post recovery paranoia (Self quarantine)." << endl;);
+					}
+					// The recovered patient feels good and goes on with his normal life
+					else{
+						++this->healthy_in_public;
+						TRACE(phase_t::hospital, cout << "is returning into public." << endl;);
+					}
+				}
+				// Patient dies
+				else if(patients_fate < recovery_or_death){
+					++this->available_hospital_beds;
+					--this->ss_in_bed;
+					--this->ss_in_bed_by_day[days];
+					++this->dead;
+					EVENT(phase_t::hospital, event_type_t::death, 1, days + 1);
+					TRACE(phase_t::hospital, cout << " has died." << endl;);
 				}
-				// The recovered patient feels good and goes on with his normal life
+				// Patient stays for another day
 				else{
-					++this->healthy_in_public;
-					DEBUG(cout << "is returning into public." << endl;);
+					TRACE(phase_t::hospital, cout << " continues their stay at the hospital." << endl;);
+					// Nothing changes
 				}
 			}
-			// Patient dies
-			else if(probability_of.hospital_recovery < patients_fate
-					&& patients_fate <= (probability_of.hospital_recovery + probability_of.hospital_death)){
-				++this->available_hospital_beds;
-				--this->ss_in_bed;
-				++this->dead;
-				DEBUG(cout << " has died." << endl;);
-			}
-			// Patient stays for another day
-			else{
-				DEBUG(cout << " continues their stay at the hospital." << endl;);
-				// Nothing changes
-			}
 		}
 
-		DEBUG(cout << "H| Start admitting patients:" << endl;);
-		// There is enough available beds so all people are admitted
-		if(this->ss_waiting_for_bed <= this->available_hospital_beds){
-			this->available_hospital_beds -= this->ss_waiting_for_bed;
-			DEBUG(cout << "H|  - All (" << this->ss_waiting_for_bed << ") patients waiting for a bed were admitted to the hospital. Unoccupied hospital beds left: " << this->available_hospital_beds << endl;);
-			this->ss_in_bed += this->ss_waiting_for_bed;
-			this->ss_waiting_for_bed = 0;
+		if (this->icu_capacity) this->IntensiveCare(rng);
+		this->AdmitPatients();
+
+		this->counted.draws += rng.Draws();
+		this->counted.deaths += this->dead - dead_before;
+		TRACE(phase_t::hospital, cout << " \\----------------" << endl;);
+	}
+
+	/* Intensive care tier, drawn per cohort of the same length of stay in both engines
+	 * - Patients in intensive care recover, die or stay with the chances of their day there
+	 * - Ward patients staying another day need intensive care with the chance of their day in the ward,
+	 *   the ones in the ward the longest take the free intensive care beds first and the rest stay in the ward
+	 * - Beds freed in the ward go to the waiting in AdmitPatients */
+	void IntensiveCare(RandomStream& rng){
+		for (unsigned int days = 0; days < this->icu_by_day.Days(); ++days) {
+			uint64_t recovered, died;
+			Trinomial(rng, this->icu_by_day[days], probability_of.IcuRecovery(days), probability_of.IcuDeath(days), recovered, died);
+			unsigned int paranoid = Binomial(rng, recovered, probability_of.post_recovery_paranoia);
+
+			this->icu_by_day[days] -= recovered + died;
+			this->icu_patients -= recovered + died;
+			this->available_icu_beds += recovered + died;
+			this->dead += died;
+			this->healthy_at_home += paranoid;
+			this->healthy_in_public += recovered - paranoid;
+			EVENT(phase_t::hospital, event_type_t::recovery, recovered, days + 1);
+			EVENT(phase_t::hospital, event_type_t::death, died, days + 1);
+			TRACE(phase_t::hospital, cout << "H|  - Day " << days + 1 << " in intensive care | Recovered: " << recovered << " (" << paranoid
+					   << " with post recovery paranoia) | Died: " << died << " | Staying: " << this->icu_by_day[days] << endl;);
 		}
-		// There is not enough available beds so some people are left waiting
-		else{
-			this->ss_waiting_for_bed -= this->available_hospital_beds;
-			DEBUG(cout << "H|  - Some (" << this->available_hospital_beds << ") patients were admitted to the hospital. Patients still waiting: " << this->ss_waiting_for_bed << endl;);
-			this->ss_in_bed += this->available_hospital_beds;
-			this->available_hospital_beds = 0;
+		this->icu_by_day.Advance();
+
+		unsigned int stepped_up = 0;
+		for (unsigned int days = this->ss_in_bed_by_day.Days(); days-- > 0 && this->available_icu_beds != 0;) {
+			const unsigned int needing = Binomial(rng, this->ss_in_bed_by_day[days], probability_of.IcuStepUp(days));
+			const unsigned int moved = min(needing, this->available_icu_beds);
+			this->ss_in_bed_by_day[days] -= moved;
+			this->ss_in_bed -= moved;
+			this->available_hospital_beds += moved;
+			this->available_icu_beds -= moved;
+			stepped_up += moved;
+			EVENT(phase_t::hospital, event_type_t::step_up, moved, days + 1);
 		}
+		this->icu_by_day[0] += stepped_up;
+		this->icu_patients += stepped_up;
+		TRACE(phase_t::hospital, cout << "H|  - Moved into intensive care: " << stepped_up << " | Intensive care beds left: "
+				   << this->available_icu_beds << endl;);
+	}
 
-		DEBUG(cout << " \\----------------" << endl;);
-		local_debug_out_enabled ? debugging_enabled = false : debugging_enabled = true;
+	/* Patients who stay start their next day in bed and free beds are given to the waiting
+	 * - The ones waiting the longest are admitted first
+	 * - Everyone left waits one more day */
+	void AdmitPatients(){
+		this->ss_in_bed_by_day.Advance();
+		// Beds freed beyond a lowered capacity close
+		const unsigned int closed = min(this->closing_hospital_beds, this->available_hospital_beds);
+		this->closing_hospital_beds -= closed;
+		this->available_hospital_beds -= closed;
+
+		TRACE(phase_t::hospital, cout << "H| Start admitting patients:" << endl;);
+		// There is enough available beds so all people are admitted, otherwise some are left waiting
+		unsigned int admitted = 0;
+		for (unsigned int days = this->ss_waiting_by_day.Days(); days-- > 0 && this->available_hospital_beds != 0;) {
+			const unsigned int admitted_today = min(this->ss_waiting_by_day[days], this->available_hospital_beds);
+			this->ss_waiting_by_day[days] -= admitted_today;
+			this->available_hospital_beds -= admitted_today;
+			admitted += admitted_today;
+			EVENT(phase_t::hospital, event_type_t::admission, admitted_today, days);
+		}
+		this->ss_waiting_for_bed -= admitted;
+		this->ss_in_bed += admitted;
+		this->ss_in_bed_by_day[0] += admitted;
+		this->counted.admissions += admitted;
+		TRACE(phase_t::hospital, cout << "H|  - Admitted: " << admitted << " | Patients still waiting: " << this->ss_waiting_for_bed
+				   << " | Unoccupied hospital beds left: " << this->available_hospital_beds << endl;);
+
+		this->ss_waiting_by_day.Advance();
 	}
 
 	/* People in self-quarantine are evaluated
 	 * - Some die
 	 * - Some recover and return to public
 	 * - Some recognize their need for medical attention and are from the next day start waiting for a hospital bed */
-	void HomeQuarantine(bool local_debug_out_enabled = false){
-		local_debug_out_enabled ? debugging_enabled = true : debugging_enabled = false;
-
-		DEBUG(cout << "Home self quarantine events: " << endl;);
-		for(unsigned int i = 1; i <= this->ms_at_home; i++){
-			float fate = percentageFraction();
-
+	void HomeQuarantine(){
+		if (this->engine == engine_t::aggregate) { AggregateHomeQuarantine(); return; }
+		RandomStream rng = this->Stream(phase_t::home_quarantine);
+
+		TRACE(phase_t::home_quarantine, cout << "Home self quarantine events: " << endl;);
+		// Everyone at home leaves it today, the counts shrink as they go
+		const unsigned int ms_at_home = this->ms_at_home, asymptomatic_at_home = this->asymptomatic_at_home;
+		for(unsigned int i = 1; i <= ms_at_home; i++){
 			// Person recovers at home an returns into public
-			if(fate <= probability_of.home_recovery){
+			if(rng.Bernoulli(threshold_of.home_recovery)){
 				--this->ms_at_home;
 				++this->healthy_in_public;
-				DEBUG(cout << "Q| - Mildly symptomatic " << i << " has recovered and returns to public." << endl;);
+				EVENT(phase_t::home_quarantine, event_type_t::recovery, 1, 0);
+				TRACE(phase_t::home_quarantine, cout << "Q| - Mildly symptomatic " << i << " has recovered and returns to public." << endl;);
 			}
 				// Person's status has worsened and needs medical attention
 			else{
 				--this->ms_at_home;
-				++this->ss_waiting_for_bed;
-				DEBUG(cout << "Q| - Mildly symptomatic " << i
+				this->StartWaitingForBed(1);
+				EVENT(phase_t::home_quarantine, event_type_t::waiting_for_bed, 1, 0);
+				TRACE(phase_t::home_quarantine, cout << "Q| - Mildly symptomatic " << i
 							<< " needs medical attention and is now waiting for a hospital bed." << endl;);
 			}
 		}
-		for (unsigned int i = 1; i <= this->asymptomatic_at_home; ++i) {
-			float fate = percentageFraction();
-
+		for (unsigned int i = 1; i <= asymptomatic_at_home; ++i) {
 			// Person recovers at home an returns into public
-			if (fate <= probability_of.home_recovery) {
+			if (rng.Bernoulli(threshold_of.home_recovery)) {
 				--this->asymptomatic_at_home;
 				++this->healthy_in_public;
-				DEBUG(cout << "Q| - Asymptomatic " << i << " has recovered and returns to public." << endl;);
+				EVENT(phase_t::home_quarantine, event_type_t::recovery, 1, 0);
+				TRACE(phase_t::home_quarantine, cout << "Q| - Asymptomatic " << i << " has recovered and returns to public." << endl;);
 			}
 			// Person's status has worsened and needs medical attention
 			else {
 				--this->asymptomatic_at_home;
-				++this->ss_waiting_for_bed;
-				DEBUG(cout << "Q| - Asymptomatic " << i
+				this->StartWaitingForBed(1);
+				EVENT(phase_t::home_quarantine, event_type_t::waiting_for_bed, 1, 0);
+				TRACE(phase_t::home_quarantine, cout << "Q| - Asymptomatic " << i
 						   << " needs medical attention and is now waiting for a hospital bed." << endl;);
 			}
 		}
 
-		DEBUG(cout << " \\----------------" << endl;);
-		local_debug_out_enabled ? debugging_enabled = false : debugging_enabled = true;
+		this->counted.draws += rng.Draws();
+		TRACE(phase_t::home_quarantine, cout << " \\----------------" << endl;);
 	}
 
 	/* After each day the incubating in incubation period advance to the next day.
 	 * If they're past the incubation period, the next day they don't meet with
 	 * anyone and either stay home or try to get admitted into the hospital to get treatment */
-	void IllnessAdvances(bool local_debug_out_enabled = false){
-		local_debug_out_enabled ? debugging_enabled = true : debugging_enabled = false;
+	void IllnessAdvances(){
+		if (this->engine == engine_t::aggregate) { AggregateIllnessAdvances(); return; }
+		RandomStream rng = this->Stream(phase_t::illness);
 
-		unsigned int past_incubation_period = incubating[this->incubation_period];
+		unsigned int past_incubation_period = this->incubating[this->incubation_period];
+		this->incubating[this->incubation_period] = 0;
 
-		DEBUG(cout << "Illness advancing events: " << endl;);
+		TRACE(phase_t::illness, cout << "Illness advancing events: " << endl;);
 
 		// Possibly advance mildly symptomatic people in public to severely symptomatic and send them to hospital
 		unsigned int mildly_symptomatic = this->ms_in_public;
 		this->ms_in_public = 0;
-		DEBUG(cout << "A| Mildly symptomatic for reevaluation: " << mildly_symptomatic << endl;);
+		TRACE(phase_t::illness, cout << "A| Mildly symptomatic for reevaluation: " << mildly_symptomatic << endl;);
 		while (mildly_symptomatic){
-			if(percentageFraction() <= probability_of.mild_symptoms){ // Gain mild symptoms
-				DEBUG(cout << "A|  Got mild symptoms - At home/In public " << this->ms_at_home << "/" << this->ms_in_public << " => ";);
-				(percentageFraction() <= probability_of.ms_staying_home) ? ++this->ms_at_home : ++this->ms_in_public;
-				DEBUG(cout << this->ms_at_home << "/" << this->ms_in_public << endl;);
+			if(rng.Bernoulli(threshold_of.mild_symptoms)){ // Gain mild symptoms
+				TRACE(phase_t::illness, cout << "A|  Got mild symptoms - At home/In public " << this->ms_at_home << "/" << this->ms_in_public << " => ";);
+				const bool at_home = rng.Bernoulli(threshold_of.ms_staying_home);
+				at_home ? ++this->ms_at_home : ++this->ms_in_public;
+				EVENT(phase_t::illness, event_type_t::mild_symptoms, 1, at_home);
+				TRACE(phase_t::illness, cout << this->ms_at_home << "/" << this->ms_in_public << endl;);
 			}
 			else { // Gain severe symptoms that require hospitalization
-				DEBUG(cout << "A|  Got severe symptoms and is now waiting for a hospital bed." << endl;);
-				++this->ss_waiting_for_bed;
+				TRACE(phase_t::illness, cout << "A|  Got severe symptoms and is now waiting for a hospital bed." << endl;);
+				this->StartWaitingForBed(1);
+				EVENT(phase_t::illness, event_type_t::severe_symptoms, 1, 0);
 			}
 
 			--mildly_symptomatic;
 		}
 
 		// Advance asymptotic incubating one day forward
-		DEBUG(cout << "A| Incubating:"<< endl;);
-		DEBUG(cout << "A|  | "; for (unsigned int a = 0; a <= this->incubation_period; ++a) { cout << incubating[a] << " | "; } cout << endl;);
-		for(unsigned int i = this->incubation_period; i >= 1; --i){
-			incubating[i] = incubating[i - 1];
-			DEBUG(cout << "A|  | "; for (unsigned int a = 0; a <= this->incubation_period; ++a) { cout << incubating[a] << " | "; } cout << endl;);
-		}
-		incubating[0] = 0;
-		DEBUG(cout << "A|  | "; for (unsigned int a = 0; a <= this->incubation_period; ++a) { cout << incubating[a] << " | "; } cout << endl;);
+		TRACE(phase_t::illness, cout << "A| Incubating:"<< endl;);
+		TRACE(phase_t::illness, cout << "A|  | "; for (unsigned int a = 0; a <= this->incubation_period; ++a) { cout << this->incubating[a] << " | "; } cout << endl;);
+		this->incubating.Advance();
+		TRACE(phase_t::illness, cout << "A|  | "; for (unsigned int a = 0; a <= this->incubation_period; ++a) { cout << this->incubating[a] << " | "; } cout << endl;);
 
 		// Process people newly past the incubation period
 		this->asymptomatic_in_public -= past_incubation_period;
-		DEBUG(cout << "A| Past incubation period: " << past_incubation_period << endl;);
+		TRACE(phase_t::illness, cout << "A| Past incubation period: " << past_incubation_period << endl;);
 		// and decide their fate
 		while (past_incubation_period){
-			if(percentageFraction() <= probability_of.mild_symptoms){ // Gain mild symptoms
-				DEBUG(cout << "A|  Got mild symptoms - At home/In public " << this->ms_at_home << "/" << this->ms_in_public << " => ";);
-				(percentageFraction() <= probability_of.ms_staying_home) ? ++this->ms_at_home : ++this->ms_in_public;
-				DEBUG(cout << this->ms_at_home << "/" << this->ms_in_public << endl;);
+			if(rng.Bernoulli(threshold_of.mild_symptoms)){ // Gain mild symptoms
+				TRACE(phase_t::illness, cout << "A|  Got mild symptoms - At home/In public " << this->ms_at_home << "/" << this->ms_in_public << " => ";);
+				const bool at_home = rng.Bernoulli(threshold_of.ms_staying_home);
+				at_home ? ++this->ms_at_home : ++this->ms_in_public;
+				EVENT(phase_t::illness, event_type_t::mild_symptoms, 1, at_home);
+				TRACE(phase_t::illness, cout << this->ms_at_home << "/" << this->ms_in_public << endl;);
 			}
 			else { // Gain severe symptoms that require hospitalization
-				DEBUG(cout << "A|  Got severe symptoms and is now waiting for a hospital bed." << endl;);
-				++this->ss_waiting_for_bed;
+				TRACE(phase_t::illness, cout << "A|  Got severe symptoms and is now waiting for a hospital bed." << endl;);
+				this->StartWaitingForBed(1);
+				EVENT(phase_t::illness, event_type_t::severe_symptoms, 1, 0);
 			}
 
 			--past_incubation_period;
 		}
 
-		DEBUG(cout << " \\----------------" << endl;);
-		local_debug_out_enabled ? debugging_enabled = false : debugging_enabled = true;
+		this->counted.draws += rng.Draws();
+		TRACE(phase_t::illness, cout << " \\----------------" << endl;);
+	}
+
+	/* Aggregate counterpart of CalculateInteractions
+	 * - The composition of each interaction circle is one multivariate hypergeometric draw
+	 *   (infectious in incubation, mildly infectious, healthy) from the people not yet in a circle
+	 * - The infections and precautionary home stays of the healthy members are binomial draws
+	 * - Circles keep being formed while both healthy and infectious people are left, as in the reference mode */
+	void AggregateCalculateInteractions() {
+		RandomStream rng = this->Stream(phase_t::interactions);
+		TRACE(phase_t::interactions, cout << "Infection spreading events: " << endl;);
+
+		uint64_t available_infectious = 0;
+		for (unsigned int i = this->is_infectious_since_day; i <= this->incubation_period; i++){
+			available_infectious += this->incubating[i];
+		}
+		available_infectious = available_infectious - this->away_infectious + this->visiting_infectious;
+		uint64_t available_mildly_infectious = this->ms_in_public - this->away_mildly_infectious + this->visiting_mildly_infectious;
+		uint64_t available_healthy = this->healthy_in_public;
+
+		TRACE(phase_t::interactions, cout << "I| Infectious in incubation: " << available_infectious << endl;);
+		TRACE(phase_t::interactions, cout << "I| Mildly infectious: " << available_mildly_infectious << endl;);
+		TRACE(phase_t::interactions, cout << "I| Available healthy: " << available_healthy << endl;);
+
+		const unsigned int asymptomatic_before = this->asymptomatic_at_home + this->asymptomatic_in_public;
+		unsigned int x = 0;
+		while (available_healthy && (available_infectious + available_mildly_infectious) && this->average_daily_interactions) {
+			uint64_t available = available_healthy + available_infectious + available_mildly_infectious;
+			uint64_t group_size = min<uint64_t>(this->average_daily_interactions, available);
+
+			uint64_t present_infectious = Hypergeometric(rng, available_infectious,
+														 available_mildly_infectious + available_healthy, group_size);
+			uint64_t present_mildly_infectious = Hypergeometric(rng, available_mildly_infectious,
+																available_healthy, group_size - present_infectious);
+			uint64_t present_healthy = group_size - present_infectious - present_mildly_infectious;
+			available_infectious -= present_infectious;
+			available_mildly_infectious -= present_mildly_infectious;
+			available_healthy -= present_healthy;
+
+			TRACE(phase_t::interactions, cout << "I| (" << x << ") | Present healthy: " << present_healthy
+					   << " | Present infectious: " << present_infectious + present_mildly_infectious << " | " << endl;);
+
+			// If interaction with at least one infectious person happened all healthy people have a chance to be affected
+			if (present_infectious + present_mildly_infectious) {
+				unsigned int infected = Binomial(rng, present_healthy, probability_of.getting_sick);
+				unsigned int infected_at_home = Binomial(rng, infected, probability_of.healthy_staying_home);
+				unsigned int scared = Binomial(rng, present_healthy - infected, probability_of.healthy_staying_home);
+
+				this->healthy_in_public -= infected + scared;
+				this->asymptomatic_at_home += infected_at_home;
+				this->asymptomatic_in_public += infected - infected_at_home;
+				this->incubating[0] += infected - infected_at_home;
+				this->healthy_at_home += scared;
+				EVENT(phase_t::interactions, event_type_t::infection, infected, x);
+				EVENT(phase_t::interactions, event_type_t::staying_home, scared, x);
+				TRACE(phase_t::interactions, cout << "I|   - Became asymptomatic: " << infected << " (" << infected_at_home << " going home)"
+						   << " | Healthy going home: " << scared << endl;);
+			}
+			++x;
+		}
+
+		this->counted.draws += rng.Draws();
+		this->counted.groups += x;
+		this->counted.infections += this->asymptomatic_at_home + this->asymptomatic_in_public - asymptomatic_before;
+		TRACE(phase_t::interactions, cout << " \\----------------" << endl;);
+	}
+
+	/* Approximation of CalculateInteractions for large circles, drawing the outcome of the whole day at once
+	 * - Only the circles with an infectious member matter and all the infectious are in them,
+	 *   so K such circles of size g hold K * g - X healthy people (X infectious in public)
+	 * - A circle of g out of A people has no infectious member with chance C(A-X, g) / C(A, g) and K is drawn
+	 *   as a binomial over all circles with the opposite chance, which ignores the slight negative correlation
+	 *   between the circles and the smaller last circle
+	 * - Infections and precautionary stays at home are then drawn for all the exposed healthy at once */
+	void ClosedFormCalculateInteractions(){
+		RandomStream rng = this->Stream(phase_t::interactions);
+		const uint64_t available_infectious = (uint64_t)this->IncubatingInfectious() - this->away_infectious + this->visiting_infectious
+											+ this->ms_in_public - this->away_mildly_infectious + this->visiting_mildly_infectious;
+		const uint64_t available_healthy = this->healthy_in_public;
+		const uint64_t available = available_healthy + available_infectious;
+		const uint64_t group_size = min<uint64_t>(this->average_daily_interactions, available);
+		if (available_healthy == 0 || available_infectious == 0 || group_size == 0) return;
+
+		const uint64_t n_of_circles = (available + group_size - 1) / group_size;
+		double no_infectious_met = 0.0;
+		if (available_healthy >= group_size) {
+			no_infectious_met = exp(lgamma(available_healthy + 1.0) - lgamma(available_healthy - group_size + 1.0)
+									- lgamma(available + 1.0) + lgamma(available - group_size + 1.0));
+		}
+		// Every infectious person is in one of the circles and a circle holds at most g of them
+		const uint64_t exposed_circles = min(max(Binomial(rng, n_of_circles, 1.0 - no_infectious_met),
+												 (available_infectious + group_size - 1) / group_size),
+											 min(n_of_circles, available_infectious));
+		const uint64_t exposed = min(available_healthy, exposed_circles * group_size - available_infectious);
+
+		const unsigned int infected = Binomial(rng, exposed, probability_of.getting_sick);
+		const unsigned int infected_at_home = Binomial(rng, infected, probability_of.healthy_staying_home);
+		const unsigned int scared = Binomial(rng, exposed - infected, probability_of.healthy_staying_home);
+		this->healthy_in_public -= infected + scared;
+		this->asymptomatic_at_home += infected_at_home;
+		this->asymptomatic_in_public += infected - infected_at_home;
+		this->incubating[0] += infected - infected_at_home;
+		this->healthy_at_home += scared;
+		EVENT(phase_t::interactions, event_type_t::infection, infected, 0);
+		EVENT(phase_t::interactions, event_type_t::staying_home, scared, 0);
+		TRACE(phase_t::interactions, cout << "I| Circles: " << n_of_circles << " of which with an infectious member: " << exposed_circles
+				   << " | Exposed healthy: " << exposed << " | Became asymptomatic: " << infected << " (" << infected_at_home
+				   << " going home) | Healthy going home: " << scared << endl;);
+
+		this->counted.draws += rng.Draws();
+		this->counted.groups += n_of_circles;
+		this->counted.infections += infected;
+	}
+
+	// People of the public formed into circles by one worker and what happened to the healthy among them
+	struct interaction_pool_t {
+		uint64_t infectious = 0, mildly_infectious = 0, healthy = 0;
+		unsigned int first_circle = 0;
+		unsigned int infected_in_public = 0, infected_at_home = 0, scared = 0, circles = 0;
+		uint64_t draws = 0;
+	};
+
+	/* Counterpart of CalculateInteractions running on interaction_threads threads
+	 * - Forming circles from a uniformly random order of the public is the same as cutting that order into pools
+	 *   of whole circles first, so the pools' compositions are successive multivariate hypergeometric draws
+	 *   and the mixing stays that of a single pass (only the last pool can end with the smaller last circle)
+	 * - Every pool forms its circles by the rules of the engine with its own random stream
+	 * - The changes of the pools are summed up in the order of the pools, so the results depend on the number
+	 *   of pools but not on the number of threads */
+	void PartitionedCalculateInteractions(){
+		RandomStream rng = this->Stream(phase_t::interactions);
+		TRACE(phase_t::interactions, cout << "Infection spreading events: " << endl;);
+
+		uint64_t available_infectious = this->IncubatingInfectious() - this->away_infectious + this->visiting_infectious;
+		uint64_t available_mildly_infectious = this->ms_in_public - this->away_mildly_infectious + this->visiting_mildly_infectious;
+		uint64_t available_healthy = this->healthy_in_public;
+		const uint64_t available = available_infectious + available_mildly_infectious + available_healthy;
+		const uint64_t group_size = this->average_daily_interactions;
+		if (group_size == 0 || available == 0) return;
+
+		const uint64_t n_of_circles = (available + group_size - 1) / group_size;
+		const unsigned int n_of_pools = (unsigned int)min<uint64_t>(this->interaction_pools, n_of_circles);
+		vector<interaction_pool_t> pools(n_of_pools);
+		for (unsigned int k = 0; k < n_of_pools; ++k) {
+			interaction_pool_t& pool = pools[k];
+			pool.first_circle = n_of_circles * k / n_of_pools;
+			if (k + 1 == n_of_pools) {
+				pool.infectious = available_infectious;
+				pool.mildly_infectious = available_mildly_infectious;
+				pool.healthy = available_healthy;
+				break;
+			}
+			const uint64_t size = (n_of_circles * (k + 1) / n_of_pools - pool.first_circle) * group_size;
+			pool.infectious = Hypergeometric(rng, available_infectious, available_mildly_infectious + available_healthy, size);
+			pool.mildly_infectious = Hypergeometric(rng, available_mildly_infectious, available_healthy, size - pool.infectious);
+			pool.healthy = size - pool.infectious - pool.mildly_infectious;
+			available_infectious -= pool.infectious;
+			available_mildly_infectious -= pool.mildly_infectious;
+			available_healthy -= pool.healthy;
+		}
+
+		WorkerPool& workers = this->interaction_workers.Get(min(ThreadCount(this->interaction_threads), this->interaction_pools));
+		workers.Run(n_of_pools, [&](unsigned int k, unsigned int){
+			this->PoolInteractions(pools[k], k);
+		});
+
+		const unsigned int asymptomatic_before = this->asymptomatic_at_home + this->asymptomatic_in_public;
+		for (unsigned int k = 0; k < n_of_pools; ++k) {
+			const interaction_pool_t& pool = pools[k];
+			this->healthy_in_public -= pool.infected_in_public + pool.infected_at_home + pool.scared;
+			this->asymptomatic_at_home += pool.infected_at_home;
+			this->asymptomatic_in_public += pool.infected_in_public;
+			this->incubating[0] += pool.infected_in_public;
+			this->healthy_at_home += pool.scared;
+			this->counted.groups += pool.circles;
+			this->counted.draws += pool.draws;
+			TRACE(phase_t::interactions, cout << "I| Pool " << k << " | Present healthy: " << pool.healthy
+					   << " | Present infectious: " << pool.infectious + pool.mildly_infectious << " | Circles: " << pool.circles
+					   << " | Became asymptomatic: " << pool.infected_in_public + pool.infected_at_home << " (" << pool.infected_at_home
+					   << " going home) | Healthy going home: " << pool.scared << endl;);
+		}
+		this->counted.draws += rng.Draws();
+		this->counted.infections += this->asymptomatic_at_home + this->asymptomatic_in_public - asymptomatic_before;
+		TRACE(phase_t::interactions, cout << " \\----------------" << endl;);
+	}
+
+	/* Forms the circles of one pool and records what happened to its healthy people in it
+	 * - Individual engine: people are picked one by one as in CalculateInteractions
+	 * - Aggregate engine: circle compositions and outcomes are drawn as in AggregateCalculateInteractions */
+	void PoolInteractions(interaction_pool_t& pool, unsigned int index) const{
+		// Substream laid out as described at max_interaction_pools
+		RandomStream rng(this->seed, this->replicate, this->day, phase_t::interactions, ((index + 1) << 16) | this->region);
+		uint64_t infectious = pool.infectious, mildly_infectious = pool.mildly_infectious, healthy = pool.healthy;
+		unsigned int x = pool.first_circle;
+
+		if (this->engine == engine_t::aggregate) {
+			while (healthy && (infectious + mildly_infectious)) {
+				const uint64_t group_size = min<uint64_t>(this->average_daily_interactions, healthy + infectious + mildly_infectious);
+				const uint64_t present_infectious = Hypergeometric(rng, infectious, mildly_infectious + healthy, group_size);
+				const uint64_t present_mildly_infectious = Hypergeometric(rng, mildly_infectious, healthy, group_size - present_infectious);
+				const uint64_t present_healthy = group_size - present_infectious - present_mildly_infectious;
+				infectious -= present_infectious;
+				mildly_infectious -= present_mildly_infectious;
+				healthy -= present_healthy;
+
+				if (present_infectious + present_mildly_infectious) {
+					const unsigned int infected = Binomial(rng, present_healthy, probability_of.getting_sick);
+					const unsigned int infected_at_home = Binomial(rng, infected, probability_of.healthy_staying_home);
+					const unsigned int scared = Binomial(rng, present_healthy - infected, probability_of.healthy_staying_home);
+					pool.infected_in_public += infected - infected_at_home;
+					pool.infected_at_home += infected_at_home;
+					pool.scared += scared;
+					EVENT(phase_t::interactions, event_type_t::infection, infected, x);
+					EVENT(phase_t::interactions, event_type_t::staying_home, scared, x);
+				}
+				++pool.circles;
+				++x;
+			}
+		}
+		else {
+			// As in CalculateInteractions the healthy are the available people who are not infectious
+			uint64_t available = infectious + mildly_infectious + healthy;
+			while (available > infectious + mildly_infectious && infectious + mildly_infectious) {
+				unsigned int present_infectious = 0, present_healthy = 0;
+				for (unsigned int i = 0; i < this->average_daily_interactions && available != 0; i++) {
+					const uint64_t picked_person = rng.Below(available) + 1;
+					--available;
+					if (picked_person <= infectious) {
+						--infectious;
+						++present_infectious;
+					}
+					else if (infectious < picked_person && picked_person < infectious + mildly_infectious) {
+						--mildly_infectious;
+						++present_infectious;
+					}
+					else {
+						++present_healthy;
+					}
+				}
+
+				if (present_infectious) {
+					for (; present_healthy; --present_healthy) {
+						if (rng.Bernoulli(threshold_of.getting_sick)) {
+							EVENT(phase_t::interactions, event_type_t::infection, 1, x);
+							if (rng.Bernoulli(threshold_of.healthy_staying_home)) ++pool.infected_at_home;
+							else ++pool.infected_in_public;
+						}
+						else if (rng.Bernoulli(threshold_of.healthy_staying_home)) {
+							++pool.scared;
+							EVENT(phase_t::interactions, event_type_t::staying_home, 1, x);
+						}
+					}
+				}
+				++pool.circles;
+				++x;
+			}
+		}
+		pool.draws = rng.Draws();
+	}
+
+	/* Aggregate counterpart of Hospital
+	 * - The recover/die/stay fate of all patients on the same day of their stay is a single multinomial draw
+	 * - Admission is deterministic and identical to the reference mode */
+	void AggregateHospital(){
+		RandomStream rng = this->Stream(phase_t::hospital);
+		const unsigned int dead_before = this->dead;
+		TRACE(phase_t::hospital, cout << "Hospital events: " << endl;);
+
+		for (unsigned int days = 0; days < this->ss_in_bed_by_day.Days(); ++days) {
+			uint64_t recovered, died;
+			Trinomial(rng, this->ss_in_bed_by_day[days], probability_of.HospitalRecovery(days), probability_of.HospitalDeath(days), recovered, died);
+			unsigned int paranoid = Binomial(rng, recovered, probability_of.post_recovery_paranoia);
+
+			this->ss_in_bed_by_day[days] -= recovered + died;
+			this->ss_in_bed -= recovered + died;
+			this->available_hospital_beds += recovered + died;
+			this->dead += died;
+			this->healthy_at_home += paranoid;
+			this->healthy_in_public += recovered - paranoid;
+			EVENT(phase_t::hospital, event_type_t::recovery, recovered, days + 1);
+			EVENT(phase_t::hospital, event_type_t::death, died, days + 1);
+			TRACE(phase_t::hospital, cout << "H|  - Day " << days + 1 << " in bed | Recovered: " << recovered << " (" << paranoid << " with post recovery paranoia)"
+					   << " | Died: " << died << " | Staying: " << this->ss_in_bed_by_day[days] << endl;);
+		}
+
+		if (this->icu_capacity) this->IntensiveCare(rng);
+		this->AdmitPatients();
+
+		this->counted.draws += rng.Draws();
+		this->counted.deaths += this->dead - dead_before;
+		TRACE(phase_t::hospital, cout << " \\----------------" << endl;);
+	}
+
+	/* Aggregate counterpart of HomeQuarantine
+	 * - Recoveries among the mildly symptomatic and asymptomatic at home are one binomial draw each
+	 * - Everyone else from these compartments starts waiting for a hospital bed */
+	void AggregateHomeQuarantine(){
+		RandomStream rng = this->Stream(phase_t::home_quarantine);
+		TRACE(phase_t::home_quarantine, cout << "Home self quarantine events: " << endl;);
+
+		unsigned int ms_recovered = Binomial(rng, this->ms_at_home, probability_of.home_recovery);
+		unsigned int asymptomatic_recovered = Binomial(rng, this->asymptomatic_at_home, probability_of.home_recovery);
+		TRACE(phase_t::home_quarantine, cout << "Q| - Mildly symptomatic recovered: " << ms_recovered << " of " << this->ms_at_home << endl;);
+		TRACE(phase_t::home_quarantine, cout << "Q| - Asymptomatic recovered: " << asymptomatic_recovered << " of " << this->asymptomatic_at_home << endl;);
+
+		this->healthy_in_public += ms_recovered + asymptomatic_recovered;
+		this->StartWaitingForBed((this->ms_at_home - ms_recovered) + (this->asymptomatic_at_home - asymptomatic_recovered));
+		EVENT(phase_t::home_quarantine, event_type_t::recovery, ms_recovered + asymptomatic_recovered, 0);
+		EVENT(phase_t::home_quarantine, event_type_t::waiting_for_bed,
+			  (this->ms_at_home - ms_recovered) + (this->asymptomatic_at_home - asymptomatic_recovered), 0);
+		this->ms_at_home = this->asymptomatic_at_home = 0;
+
+		this->counted.draws += rng.Draws();
+		TRACE(phase_t::home_quarantine, cout << " \\----------------" << endl;);
+	}
+
+	/* Splits people whose illness is reevaluated into mildly symptomatic at home, in public and severely symptomatic */
+	void AggregateSymptomsOnset(RandomStream& rng, unsigned int reevaluated){
+		unsigned int mild = Binomial(rng, reevaluated, probability_of.mild_symptoms);
+		unsigned int mild_at_home = Binomial(rng, mild, probability_of.ms_staying_home);
+		TRACE(phase_t::illness, cout << "A|  Of " << reevaluated << " got mild symptoms: " << mild << " (" << mild_at_home << " at home)"
+				   << " | got severe symptoms: " << reevaluated - mild << endl;);
+
+		this->ms_at_home += mild_at_home;
+		this->ms_in_public += mild - mild_at_home;
+		this->StartWaitingForBed(reevaluated - mild);
+		EVENT(phase_t::illness, event_type_t::mild_symptoms, mild, mild_at_home);
+		EVENT(phase_t::illness, event_type_t::severe_symptoms, reevaluated - mild, 0);
+	}
+
+	/* Aggregate counterpart of IllnessAdvances
+	 * - Mildly symptomatic in public and people past the incubation period are split by two binomial draws each */
+	void AggregateIllnessAdvances(){
+		RandomStream rng = this->Stream(phase_t::illness);
+		TRACE(phase_t::illness, cout << "Illness advancing events: " << endl;);
+
+		unsigned int past_incubation_period = this->incubating[this->incubation_period];
+		this->incubating[this->incubation_period] = 0;
+
+		unsigned int mildly_symptomatic = this->ms_in_public;
+		this->ms_in_public = 0;
+		TRACE(phase_t::illness, cout << "A| Mildly symptomatic for reevaluation: " << mildly_symptomatic << endl;);
+		AggregateSymptomsOnset(rng, mildly_symptomatic);
+
+		// Advance asymptotic incubating one day forward
+		this->incubating.Advance();
+
+		this->asymptomatic_in_public -= past_incubation_period;
+		TRACE(phase_t::illness, cout << "A| Past incubation period: " << past_incubation_period << endl;);
+		AggregateSymptomsOnset(rng, past_incubation_period);
+
+		this->counted.draws += rng.Draws();
+		TRACE(phase_t::illness, cout << " \\----------------" << endl;);
+	}
+
+	/* Simulates one day: interactions in public, home quarantine, illness progression and hospital care
+	 * - The phases are measured into the metrics when given */
+	void AdvanceDay(RunMetrics* metrics = nullptr){
+		++this->day;
+		if (metrics) metrics->StartDay(this->day);
+		TRACE(phase_t::setup, cout << "----- DAY " << this->day << " -----" << endl;);
+
+		Measured(metrics, METRIC_INTERACTIONS, this->counted, [this]{ this->CalculateInteractions(); });
+
+		Measured(metrics, METRIC_HOME_QUARANTINE, this->counted, [this]{ this->HomeQuarantine(); });
+
+		Measured(metrics, METRIC_ILLNESS, this->counted, [this]{ this->IllnessAdvances(); });
+
+		Measured(metrics, METRIC_HOSPITAL, this->counted, [this]{ this->Hospital(); });
+	}
+
+	// Values of the data.dat columns for the current day
+	series_values_t Series() const{
+		series_values_t values;
+		values[SICK] = this->total_population - this->dead - (this->healthy_at_home + this->healthy_in_public);
+		values[DEAD] = this->dead;
+		values[HEALTHY] = this->healthy_at_home + this->healthy_in_public;
+		values[ASYMPTOMATIC] = this->asymptomatic_at_home + this->asymptomatic_in_public;
+		values[MILDLY_SYMPTOMATIC] = this->ms_at_home + this->ms_in_public;
+		values[SEVERELY_SYMPTOMATIC] = this->ss_waiting_for_bed + this->ss_in_bed + this->icu_patients;
+		return values;
 	}
 
 	void Report() const{
@@ -353,229 +1049,2617 @@ public:
 		cout << "Mild symptoms:    " << this->ms_at_home + this->ms_in_public << endl
 			 << " - At home:       " << this->ms_at_home << endl
 			 << " - In public:     " << this->ms_in_public << endl;
-		cout << "Severe symptoms:                " << this->ss_waiting_for_bed + this->ss_in_bed << endl
+		cout << "Severe symptoms:                " << this->ss_waiting_for_bed + this->ss_in_bed + this->icu_patients << endl
 			 << " - Waiting for a hospital bed:  " << this->ss_waiting_for_bed << endl
 			 << " - In a hospital bed:           " << this->ss_in_bed << endl;
+		if (this->icu_capacity) cout << " - In intensive care:           " << this->icu_patients << endl;
 		cout << "========== END OF REPORT ==========" << endl;
 	}
 
+	// Saves or restores the whole state, see checkpoint.h
+	template <class Archive>
+	void Checkpoint(Archive& archive){
+		archive.Value(this->day);
+		archive.Value(this->total_population);
+		archive.Value(this->incubation_period);
+		archive.Value(this->is_infectious_since_day);
+		archive.Value(this->average_daily_interactions);
+		archive.Value(this->dead);
+		archive.Value(this->healthy_at_home);
+		archive.Value(this->healthy_in_public);
+		archive.Value(this->asymptomatic_at_home);
+		archive.Value(this->asymptomatic_in_public);
+		archive.Value(this->ms_at_home);
+		archive.Value(this->ms_in_public);
+		archive.Value(this->ss_waiting_for_bed);
+		archive.Value(this->ss_in_bed);
+		archive.Value(this->available_hospital_beds);
+		archive.Value(this->incubating);
+		archive.Value(this->ss_waiting_by_day);
+		archive.Value(this->ss_in_bed_by_day);
+		archive.Value(this->closing_hospital_beds);
+		archive.Value(this->icu_capacity);
+		archive.Value(this->icu_patients);
+		archive.Value(this->available_icu_beds);
+		archive.Value(this->icu_by_day);
+		this->probability_of.Checkpoint(archive);
+		this->threshold_of = thresholds_t(this->probability_of);
+		archive.Value(this->engine);
+		archive.Value(this->interaction_pools);
+		archive.Value(this->closed_form_interactions);
+		archive.Value(this->seed);
+		archive.Value(this->replicate);
+		archive.Value(this->region);
+		archive.Value(this->visiting_infectious);
+		archive.Value(this->visiting_mildly_infectious);
+		archive.Value(this->away_infectious);
+		archive.Value(this->away_mildly_infectious);
+	}
+
 };
 
-void PrintHelp(){
-	cout << "========== Help message for infection progress simulator ==========" << endl
-		 << " Arguments:" << endl
-		 << "   - simDays              Simulation length in days" << endl
-		 << "   - population           Total population" << endl
-		 << "   - initSick             Number of sick people on the first simulation day" << endl
-		 << "   - incubPeriod          Incubation period (after which people develop mild or severe symptoms)" << endl
-		 << "   - infectSince          Number of incubation days passed for the person to be infectious" << endl
-		 << "   - avgDailyInter        Number of random people that meet every day" << endl
-		 << "   - hospCap              Total number of hospital beds available" << endl
-		 << "   - CgetSick             Chance of getting infected after meeting an infectious person (in %)" << endl
-		 << "   - ChealthyAtHome       Chance of staying at home as a precaution after meeting an infectious person (in %)" << endl
-		 << "   - CmildSympt           Chance of developing mild symptoms after the incubation period (in %)" << endl
-		 << "   - CmildSymAtHome       Chance of staying at home when having mild symptoms (in %)" << endl
-		 << "   - ChospitalRec         Chance of recovery when hospitalized (in %)" << endl
-		 << "   - ChospitalDeath       Chance of dying when hospitalized (in %)" << endl
-		 << "   - ChomeRec             Chance of recovering in home isolation (in %)" << endl
-		 << "   - Cprp                 Chance of post recovery paranoia (staying at home until the end of the simulation) (in %)" << endl
-		 << "  When an argument is not used it is All arguments have to have a whole positive number as a value." << endl
-		 << endl
-		 << " Chances deduced from chance arguments:" << endl
-	  	 << "   * 100% - CgetSick%" << endl
-	  	 << "	          -> Chance of staying healthy after meeting an infectious person" << endl
-	  	 << "   * 100% - ChealthyAtHome%" << endl
-	  	 << "	          -> Chance of staying in public after meeting an infectious person" << endl
-	  	 << "   * 100% - CmildSympt%" << endl
-	  	 << "	          -> Chance of developing severe symptoms after the incubation periodand going to the hospital" << endl
-	  	 << "   * 100% - CmildSymAtHome%" << endl
-	  	 << "	          -> Chance of staying in public after developing mild symptoms" << endl
-	  	 << "   * 100% - ChospitalRec% - ChospitalDeath%" << endl
-	  	 << "	          -> Chance of staying healthy after meeting an infectious person" << endl
-	  	 << "   * 100% - ChomeRec%" << endl
-	  	 << "	          -> Chance of developing severe symptoms at home and going to the hospital" << endl
-	  	 << "   * 100% - Cprp%" << endl
-	  	 << "	          -> Chance of staying in public after recovering" << endl
-	  	 << endl;
-}
+// Population of the default build, traced in the phases selected by IMS_TRACE
+typedef BasicPopulation<DefaultTrace> Population;
 
-int main(int argc, char* argv[]) {
-	bool local_debugging_enabled = false;
+/* Mean-field counterpart of Population
+ * - Every compartment holds the expected number of people, so the model becomes a system of difference equations
+ * - The phases apply the same rules as the stochastic engines with every draw replaced by its expectation
+ * - Advancing a day costs O(incubation period), independent of the population size */
+class MeanFieldPopulation {
+public:
+	unsigned int day;
+	unsigned int incubation_period, is_infectious_since_day, average_daily_interactions;
+	double total_population, dead;
+	double healthy_at_home, healthy_in_public;
+	double asymptomatic_at_home, asymptomatic_in_public;
+	double ms_at_home, ms_in_public;
+	double ss_waiting_for_bed, ss_in_bed;
+	double available_hospital_beds;
+	ResidenceHistogram<double> incubating;
+	// ss_in_bed by the number of days spent in a bed
+	ResidenceHistogram<double> ss_in_bed_by_day;
+	probabilities_t probability_of;
+	// Expected events so far, for the metrics
+	phase_counters_t counted;
+
+	MeanFieldPopulation(unsigned int total_population,
+						unsigned int incubation_period,
+						unsigned int initial_number_of_sick,
+						unsigned int is_infectious_since_day,
+						unsigned int average_daily_interactions,
+						unsigned int number_of_hospital_beds)
+						{
+		this->day = 0;
+		this->dead = this->healthy_at_home = this->asymptomatic_at_home = this->ms_at_home = this->ms_in_public
+			= this->ss_waiting_for_bed = this->ss_in_bed = 0.0;
 
-	unsigned int number_of_simulation_days = 7;
+		this->total_population = total_population;
+		this->incubation_period = incubation_period-1;
+		this->is_infectious_since_day = is_infectious_since_day-1;
+		this->average_daily_interactions = average_daily_interactions;
+		this->healthy_in_public = (double)total_population - initial_number_of_sick;
+		this->available_hospital_beds = number_of_hospital_beds;
+		this->asymptomatic_in_public = initial_number_of_sick;
+		this->incubating = ResidenceHistogram<double>(incubation_period);
+		if (incubation_period) this->incubating[0] = initial_number_of_sick;
+	}
 
-	unsigned int total_population = 1324277;
-	unsigned int initial_number_of_sick = 6834; // Number of patients 0
-	unsigned int incubation_period = 5; // Number of days before symptoms appear
-	unsigned int is_infectious_since_day = 4; // On which incubation day the person becomes infectious
-	unsigned int average_daily_interactions = 2000; // Size of the daily interaction circle
-	unsigned int hospital_capacity = 836; // Number of total available hospital beds
+	void SetProbabilities(const probabilities_t& probabilities){
+		this->probability_of = probabilities;
+		this->ss_in_bed_by_day.Resize(probabilities.HospitalDays());
+	}
 
+	/* Expected spread of infection between people in public
+	 * - A healthy person is exposed when at least one of the other members of their circle is infectious,
+	 *   which for circles drawn without replacement happens with chance 1 - C(A-1-X, g-1) / C(A-1, g-1)
+	 *   (A people available, X of them infectious, circles of size g)
+	 * - Exposed people get infected and stay at home with the same chances as in CalculateInteractions */
+	void CalculateInteractions(){
+		double available_infectious = 0.0;
+		for (unsigned int i = this->is_infectious_since_day; i <= this->incubation_period; i++){
+			available_infectious += this->incubating[i];
+		}
+		available_infectious += this->ms_in_public;
+		const double available = this->healthy_in_public + available_infectious;
+		const double others_in_group = min((double)this->average_daily_interactions, available) - 1.0;
+		if (this->healthy_in_public <= 0.0 || available_infectious <= 0.0 || others_in_group < 0.0) return;
+
+		double no_infectious_met;
+		if (available - 1.0 - available_infectious < others_in_group) {
+			no_infectious_met = 0.0;
+		}
+		else {
+			no_infectious_met = exp(lgamma(available - available_infectious) - lgamma(available - available_infectious - others_in_group)
+									- lgamma(available) + lgamma(available - others_in_group));
+		}
 
-	probability_of.getting_sick = 0.10;	// Chance of catching it from an infectious person they met
-	probability_of.healthy_staying_home = 0.05; // Chance of prevention by self quarantine
-	probability_of.mild_symptoms = 0.80; // Chance of developing mild symptoms after passing the incubation period (Leaving 20% chance to develop severe symptoms)
-	probability_of.ms_staying_home = 0.95; // Chance of self quarantine after developing mild symptoms (Leaving 5% chance of staying in public)
-
-	probability_of.hospital_recovery = 0.90;
-	probability_of.hospital_death = 0.03;
-	// Leaving 7% chance to stay in hospital for another day
-
-	probability_of.home_recovery = 0.90;
-	// Leaving 60% chance of needing hospitalization
-
-	probability_of.post_recovery_paranoia = 0.15;
-	// Leaving 85% chance of self quarantine after overcoming the illness
-
-	const option long_opts[] = {
-			{"simDays", required_argument, nullptr, 'a'},
-			{"population", required_argument, nullptr, 'b'},
-			{"initSick", required_argument, nullptr, 'c'},
-			{"incubPeriod", required_argument, nullptr, 'd'},
-			{"infectSince", required_argument, nullptr, 'e'},
-			{"avgDailyInter", required_argument, nullptr, 'f'},
-			{"hospCap", required_argument, nullptr, 'g'},
-			{"CgetSick", required_argument, nullptr, 'q'},
-			{"ChealthyAtHome", required_argument, nullptr, 'i'},
-			{"CmildSympt", required_argument, nullptr, 'j'},
-			{"CmildSymAtHome", required_argument, nullptr, 'k'},
-			{"ChospitalRec", required_argument, nullptr, 'l'},
-			{"ChospitalDeath", required_argument, nullptr, 'm'},
-			{"ChomeRec", required_argument, nullptr, 'n'},
-			{"Cprp", required_argument, nullptr, 'p'},
-			{"help", no_argument, nullptr, 'h'},
-			{nullptr, no_argument, nullptr, 0}
-	};
+		const double exposed = this->healthy_in_public * (1.0 - no_infectious_met);
+		const double infected = exposed * probability_of.getting_sick;
+		const double infected_at_home = infected * probability_of.healthy_staying_home;
+		const double scared = (exposed - infected) * probability_of.healthy_staying_home;
+
+		this->healthy_in_public -= infected + scared;
+		this->asymptomatic_at_home += infected_at_home;
+		this->asymptomatic_in_public += infected - infected_at_home;
+		this->incubating[0] += infected - infected_at_home;
+		this->healthy_at_home += scared;
+		this->counted.groups += available / (others_in_group + 1.0);
+		this->counted.infections += infected;
+	}
 
-	local_debugging_enabled ? debugging_enabled = true : debugging_enabled = false;
-	while (true)
-	{
-		const auto opt = getopt_long_only(argc, argv, "", long_opts, nullptr);
+	/* Expected outcomes of home quarantine: recoveries return to public, everyone else waits for a hospital bed */
+	void HomeQuarantine(){
+		const double recovered = (this->ms_at_home + this->asymptomatic_at_home) * probability_of.home_recovery;
+		this->ss_waiting_for_bed += this->ms_at_home + this->asymptomatic_at_home - recovered;
+		this->healthy_in_public += recovered;
+		this->ms_at_home = this->asymptomatic_at_home = 0.0;
+	}
 
-		if (opt == -1)
-			break;
+	/* Expected symptom onset of the mildly symptomatic in public and of people leaving the incubation period */
+	void IllnessAdvances(){
+		const double past_incubation_period = this->incubating[this->incubation_period];
+		const double reevaluated = this->ms_in_public + past_incubation_period;
 
-		switch (opt)
-		{
-			case 'a':
-				number_of_simulation_days = std::stoul(optarg);
-				DEBUG(std::cout << "Number of simulation days set to: " << number_of_simulation_days << endl;);
-				break;
-			case 'b':
-				total_population = std::stoul(optarg);
-				DEBUG(std::cout << "Total population set to: " << total_population << endl;);
-				break;
-			case 'c':
-				initial_number_of_sick = std::stoul(optarg);
-				DEBUG(std::cout << "Initial number of sick set to: " << initial_number_of_sick << std::endl;);
-				break;
-			case 'd':
-				incubation_period = std::stoul(optarg);
-				DEBUG(std::cout << "Incubation period set to: " << incubation_period << std::endl;);
-				break;
-			case 'e':
-				is_infectious_since_day = std::stoul(optarg);
-				DEBUG(std::cout << "Infectious since day X set to: " << is_infectious_since_day << std::endl;);
-				break;
-			case 'f':
-				average_daily_interactions = std::stoul(optarg);
-				DEBUG(std::cout << "Average daily interactions set to: " << average_daily_interactions << std::endl;);
-				break;
-			case 'g':
-				hospital_capacity = std::stoul(optarg);
-				DEBUG(std::cout << "Hospital bed capacity set to: " << hospital_capacity << std::endl;);
-				break;
-			case 'q':
-				probability_of.getting_sick = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of getting sick set to: " << probability_of.getting_sick*100 << "%" << std::endl;);
-				break;
-			case 'i':
-				probability_of.healthy_staying_home = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of healthy people isolating set to: " << probability_of.healthy_staying_home*100 << "%" << std::endl;);
-				break;
-			case 'j':
-				probability_of.mild_symptoms = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of developing mild symptoms set to: " << probability_of.mild_symptoms*100 << "%" << std::endl;);
-				break;
-			case 'k':
-				probability_of.ms_staying_home = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of staying home when having mild symptoms set to: " << probability_of.ms_staying_home*100 << "%" << std::endl;);
-				break;
-			case 'l':
-				probability_of.hospital_recovery = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of recovery when hospitalized set to: " << probability_of.hospital_recovery*100 << "%" << std::endl;);
-				break;
-			case 'm':
-				probability_of.hospital_death = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of dying when hospitalized set to: " << probability_of.hospital_death*100 << "%" << std::endl;);
-				break;
-			case 'n':
-				probability_of.home_recovery = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of recovering in home isolation set to: " << probability_of.home_recovery*100 << "%" << std::endl;);
-				break;
-			case 'p':
-				probability_of.post_recovery_paranoia = (float)(std::stoi(optarg))/100;
-				DEBUG(std::cout << "Probability of post recovery paranoia set to: " << probability_of.post_recovery_paranoia*100 << "%" << std::endl;);
-				break;
-			case 'h': // -h or --help
-			case '?': // Unrecognized option
-			default:
-				PrintHelp();
-				return 0;
-		}	
+		this->incubating[this->incubation_period] = 0.0;
+		this->incubating.Advance();
+		this->asymptomatic_in_public -= past_incubation_period;
+
+		const double mild = reevaluated * probability_of.mild_symptoms;
+		this->ms_at_home += mild * probability_of.ms_staying_home;
+		this->ms_in_public = mild * (1.0 - probability_of.ms_staying_home);
+		this->ss_waiting_for_bed += reevaluated - mild;
 	}
-	local_debugging_enabled ? debugging_enabled = false : debugging_enabled = true;
 
-	incubating = new unsigned int[incubation_period];
-	incubating[0] = initial_number_of_sick;
-	for (unsigned int i = 1; i < incubation_period; i++){
-		incubating[i] = 0;
+	/* Expected hospital care: recoveries and deaths by the day of stay free beds that are then filled from the waiting */
+	void Hospital(){
+		for (unsigned int days = 0; days < this->ss_in_bed_by_day.Days(); ++days) {
+			const double recovered = this->ss_in_bed_by_day[days] * probability_of.HospitalRecovery(days);
+			const double died = this->ss_in_bed_by_day[days] * probability_of.HospitalDeath(days);
+			const double paranoid = recovered * probability_of.post_recovery_paranoia;
+
+			this->ss_in_bed_by_day[days] -= recovered + died;
+			this->ss_in_bed -= recovered + died;
+			this->available_hospital_beds += recovered + died;
+			this->dead += died;
+			this->healthy_at_home += paranoid;
+			this->healthy_in_public += recovered - paranoid;
+			this->counted.deaths += died;
+		}
+		this->ss_in_bed_by_day.Advance();
+
+		const double admitted = min(this->ss_waiting_for_bed, this->available_hospital_beds);
+		this->available_hospital_beds -= admitted;
+		this->ss_waiting_for_bed -= admitted;
+		this->ss_in_bed += admitted;
+		this->ss_in_bed_by_day[0] += admitted;
+		this->counted.admissions += admitted;
 	}
-	const unsigned int n_of_sim_days = number_of_simulation_days;
-	Population* archive[n_of_sim_days];
 
-	Population population = Population(total_population, incubation_period, initial_number_of_sick,
-									   is_infectious_since_day, average_daily_interactions, hospital_capacity);
-	population.day = 0;
+	void AdvanceDay(RunMetrics* metrics = nullptr){
+		++this->day;
+		if (metrics) metrics->StartDay(this->day);
+		Measured(metrics, METRIC_INTERACTIONS, this->counted, [this]{ this->CalculateInteractions(); });
+		Measured(metrics, METRIC_HOME_QUARANTINE, this->counted, [this]{ this->HomeQuarantine(); });
+		Measured(metrics, METRIC_ILLNESS, this->counted, [this]{ this->IllnessAdvances(); });
+		Measured(metrics, METRIC_HOSPITAL, this->counted, [this]{ this->Hospital(); });
+	}
+
+	series_values_t Series() const{
+		series_values_t values;
+		values[SICK] = this->total_population - this->dead - (this->healthy_at_home + this->healthy_in_public);
+		values[DEAD] = this->dead;
+		values[HEALTHY] = this->healthy_at_home + this->healthy_in_public;
+		values[ASYMPTOMATIC] = this->asymptomatic_at_home + this->asymptomatic_in_public;
+		values[MILDLY_SYMPTOMATIC] = this->ms_at_home + this->ms_in_public;
+		values[SEVERELY_SYMPTOMATIC] = this->ss_waiting_for_bed + this->ss_in_bed;
+		return values;
+	}
 
-	while(number_of_simulation_days) {
-		++population.day;
-		debugging_enabled = local_debugging_enabled;
-		DEBUG(cout << "----- DAY " << population.day << " -----" << endl;);
+	// Saves or restores the whole state, see checkpoint.h
+	template <class Archive>
+	void Checkpoint(Archive& archive){
+		archive.Value(this->day);
+		archive.Value(this->incubation_period);
+		archive.Value(this->is_infectious_since_day);
+		archive.Value(this->average_daily_interactions);
+		archive.Value(this->total_population);
+		archive.Value(this->dead);
+		archive.Value(this->healthy_at_home);
+		archive.Value(this->healthy_in_public);
+		archive.Value(this->asymptomatic_at_home);
+		archive.Value(this->asymptomatic_in_public);
+		archive.Value(this->ms_at_home);
+		archive.Value(this->ms_in_public);
+		archive.Value(this->ss_waiting_for_bed);
+		archive.Value(this->ss_in_bed);
+		archive.Value(this->available_hospital_beds);
+		archive.Value(this->incubating);
+		archive.Value(this->ss_in_bed_by_day);
+		this->probability_of.Checkpoint(archive);
+	}
+};
 
-		population.CalculateInteractions(local_debugging_enabled);
+/* Agent based counterpart of Population
+ * - Every person is an agent; their state is kept in struct-of-arrays form, one contiguous column per attribute
+ * - Every phase is a linear sweep over the columns applying the rules of the same phase of Population
+ * - Aggregating the agents gives back a Population, so reports and series are shared with the compartment engines */
+class AgentPopulation {
+public:
+	enum status_t : uint8_t { HEALTHY, ASYMPTOMATIC, MILDLY_SYMPTOMATIC, SEVERELY_SYMPTOMATIC, DEAD };
 
-		population.HomeQuarantine(local_debugging_enabled);
+	unsigned int day;
+	unsigned int total_population, incubation_period, is_infectious_since_day, average_daily_interactions;
+	probabilities_t probability_of;
+	thresholds_t threshold_of;
+	uint64_t seed = 0;
+	unsigned int replicate = 0;
+	// Random draws and events so far, for the metrics
+	phase_counters_t counted;
+
+	// Agent columns
+	vector<uint8_t> status;
+	vector<uint16_t> days_in_state;
+	vector<uint8_t> in_public;
+	vector<int32_t> bed;
+	// Day a severely symptomatic agent started waiting for a bed, or was admitted to it
+	vector<uint32_t> hospital_day;
+
+	AgentPopulation(unsigned int total_population,
+					unsigned int incubation_period,
+					unsigned int initial_number_of_sick,
+					unsigned int is_infectious_since_day,
+					unsigned int average_daily_interactions,
+					unsigned int number_of_hospital_beds)
+					{
+		this->day = 0;
+		this->total_population = total_population;
+		this->incubation_period = incubation_period-1;
+		this->is_infectious_since_day = is_infectious_since_day-1;
+		this->average_daily_interactions = average_daily_interactions;
 
-		population.IllnessAdvances(local_debugging_enabled);
+		this->status.assign(total_population, HEALTHY);
+		this->days_in_state.assign(total_population, 0);
+		this->in_public.assign(total_population, 1);
+		this->bed.assign(total_population, -1);
+		this->hospital_day.assign(total_population, 0);
+		// Patients 0 start their incubation period in public
+		fill(this->status.begin(), this->status.begin() + min(initial_number_of_sick, total_population), ASYMPTOMATIC);
+
+		this->number_of_hospital_beds = number_of_hospital_beds;
+		for (unsigned int b = number_of_hospital_beds; b > 0; --b) {
+			this->free_beds.push_back(b - 1);
+		}
+	}
 
-		population.Hospital(local_debugging_enabled);
+	void SetProbabilities(const probabilities_t& probabilities){
+		this->probability_of = probabilities;
+		this->threshold_of = thresholds_t(probabilities);
+	}
 
-		debugging_enabled = local_debugging_enabled;
-		DEBUG(population.Report(););
-		unsigned int c = population.day-1;
-		archive[c] = new Population(0,0,0,0,0,0);
-		*archive[c] = population;
-		--number_of_simulation_days;
+	RandomStream Stream(phase_t phase) const {
+		return RandomStream(this->seed, this->replicate, this->day, phase);
 	}
 
-	ofstream myfile ("data.dat");
-	if (myfile.is_open())
-	{
-		myfile << "# Day Sick Dead Healthy Asymptomatic Mildly_symptomatic Severely_symptomatic\n";
-		for(unsigned int i = 0; i < population.day; ++i){
-			myfile << archive[i]->day
-					<< " " << archive[i]->total_population - archive[i]->dead - (archive[i]->healthy_at_home + archive[i]->healthy_in_public)
-					<< " " << archive[i]->dead
-				  	<< " " << archive[i]->healthy_at_home + archive[i]->healthy_in_public
-					<< " " << archive[i]->asymptomatic_at_home + archive[i]->asymptomatic_in_public
-					<< " " << archive[i]->ms_at_home + archive[i]->ms_in_public
-					<< " " << archive[i]->ss_waiting_for_bed + archive[i]->ss_in_bed << "\n";
-		}
-		myfile.close();
-	}
-	else cout << "Unable to open file";
-
-	population.Report();
-	return 0;
+	/* Simulates the spread of infection between agents in public
+	 * - Healthy and infectious agents in public are shuffled and consecutive runs of average_daily_interactions
+	 *   of them form the interaction circles, which is a uniformly random partition as in Population
+	 * - Healthy members of a circle with an infectious member get infected or go home with the usual chances */
+	void CalculateInteractions(){
+		RandomStream rng = this->Stream(phase_t::interactions);
+
+		this->pool.clear();
+		for (uint32_t a = 0; a < this->total_population; ++a) {
+			if (this->in_public[a] && (this->status[a] == HEALTHY || this->IsInfectious(a))) this->pool.push_back(a);
+		}
+		for (uint32_t i = this->pool.size(); i > 1; --i) {
+			swap(this->pool[i - 1], this->pool[rng.Below(i)]);
+		}
+
+		const size_t group_size = max(this->average_daily_interactions, 1u);
+		for (size_t first = 0; first < this->pool.size(); first += group_size) {
+			const size_t last = min(first + group_size, this->pool.size());
+
+			++this->counted.groups;
+			bool infectious_present = false;
+			for (size_t i = first; i < last && !infectious_present; ++i) {
+				infectious_present = this->status[this->pool[i]] != HEALTHY;
+			}
+			if (!infectious_present) continue;
+
+			for (size_t i = first; i < last; ++i) {
+				const uint32_t a = this->pool[i];
+				if (this->status[a] != HEALTHY) continue;
+				if (rng.Bernoulli(this->threshold_of.getting_sick)) {
+					this->ChangeStatus(a, ASYMPTOMATIC);
+					++this->counted.infections;
+					if (rng.Bernoulli(this->threshold_of.healthy_staying_home)) this->in_public[a] = 0;
+				}
+				else if (rng.Bernoulli(this->threshold_of.healthy_staying_home)) {
+					this->in_public[a] = 0;
+				}
+			}
+		}
+		this->counted.draws += rng.Draws();
+	}
+
+	/* Agents in self-quarantine with symptoms or an infection recover and return to public or start waiting for a bed */
+	void HomeQuarantine(){
+		RandomStream rng = this->Stream(phase_t::home_quarantine);
+		for (uint32_t a = 0; a < this->total_population; ++a) {
+			if (this->in_public[a] || (this->status[a] != ASYMPTOMATIC && this->status[a] != MILDLY_SYMPTOMATIC)) continue;
+			if (rng.Bernoulli(this->threshold_of.home_recovery)) {
+				this->ChangeStatus(a, HEALTHY);
+				this->in_public[a] = 1;
+			}
+			else {
+				this->ChangeStatus(a, SEVERELY_SYMPTOMATIC);
+			}
+		}
+		this->counted.draws += rng.Draws();
+	}
+
+	/* Agents incubating in public advance a day, those past the incubation period and the mildly symptomatic
+	 * in public develop mild or severe symptoms */
+	void IllnessAdvances(){
+		RandomStream rng = this->Stream(phase_t::illness);
+		for (uint32_t a = 0; a < this->total_population; ++a) {
+			const bool incubating = this->status[a] == ASYMPTOMATIC && this->in_public[a];
+			const bool past_incubation_period = incubating && this->days_in_state[a] >= this->incubation_period;
+			const bool reevaluated = this->status[a] == MILDLY_SYMPTOMATIC && this->in_public[a];
+
+			if (past_incubation_period || reevaluated) {
+				if (rng.Bernoulli(this->threshold_of.mild_symptoms)) {
+					this->ChangeStatus(a, MILDLY_SYMPTOMATIC);
+					this->in_public[a] = !rng.Bernoulli(this->threshold_of.ms_staying_home);
+				}
+				else {
+					this->ChangeStatus(a, SEVERELY_SYMPTOMATIC);
+					this->in_public[a] = 0;
+				}
+			}
+			else if (this->days_in_state[a] < UINT16_MAX) {
+				++this->days_in_state[a];
+			}
+		}
+		this->counted.draws += rng.Draws();
+	}
+
+	/* Patients in bed recover, die or stay with the chances of their day of stay,
+	 * then the waiting are admitted while there are free beds, the longest waiting first */
+	void Hospital(){
+		RandomStream rng = this->Stream(phase_t::hospital);
+		const unsigned int last_day = this->threshold_of.hospital_recovery_by_day.size() - 1;
+		for (uint32_t a = 0; a < this->total_population; ++a) {
+			if (this->status[a] != SEVERELY_SYMPTOMATIC || this->bed[a] < 0) continue;
+			// The first day of stay is the day after the admission
+			const unsigned int days = min<unsigned int>(this->day - this->hospital_day[a] - 1, last_day);
+			const uint32_t patients_fate = rng();
+			if (patients_fate < this->threshold_of.hospital_recovery_by_day[days]) {
+				this->Discharge(a, HEALTHY);
+				this->in_public[a] = !rng.Bernoulli(this->threshold_of.post_recovery_paranoia);
+			}
+			else if (patients_fate < this->threshold_of.hospital_recovery_or_death_by_day[days]) {
+				this->Discharge(a, DEAD);
+				++this->counted.deaths;
+			}
+		}
+
+		this->waiting.clear();
+		for (uint32_t a = 0; a < this->total_population && !this->free_beds.empty(); ++a) {
+			if (this->status[a] == SEVERELY_SYMPTOMATIC && this->bed[a] < 0) this->waiting.push_back(a);
+		}
+		// Only the order of the admitted matters, ties go by index
+		if (this->waiting.size() > this->free_beds.size()) {
+			stable_sort(this->waiting.begin(), this->waiting.end(), [this](uint32_t a, uint32_t b){
+				return this->hospital_day[a] < this->hospital_day[b];
+			});
+			this->waiting.resize(this->free_beds.size());
+		}
+		for (uint32_t a : this->waiting) {
+			this->bed[a] = this->free_beds.back();
+			this->free_beds.pop_back();
+			this->hospital_day[a] = this->day;
+			++this->counted.admissions;
+		}
+		this->counted.draws += rng.Draws();
+	}
+
+	void AdvanceDay(RunMetrics* metrics = nullptr){
+		++this->day;
+		if (metrics) metrics->StartDay(this->day);
+		Measured(metrics, METRIC_INTERACTIONS, this->counted, [this]{ this->CalculateInteractions(); });
+		Measured(metrics, METRIC_HOME_QUARANTINE, this->counted, [this]{ this->HomeQuarantine(); });
+		Measured(metrics, METRIC_ILLNESS, this->counted, [this]{ this->IllnessAdvances(); });
+		Measured(metrics, METRIC_HOSPITAL, this->counted, [this]{ this->Hospital(); });
+	}
+
+	/* Counts the agents into the compartments of Population */
+	Population Compartments() const{
+		Population population = Population(this->total_population, this->incubation_period + 1, 0,
+										   this->is_infectious_since_day + 1, this->average_daily_interactions, 0);
+		population.day = this->day;
+		population.SetProbabilities(this->probability_of);
+		population.healthy_in_public = 0;
+		population.available_hospital_beds = this->free_beds.size();
+		for (uint32_t a = 0; a < this->total_population; ++a) {
+			const bool public_a = this->in_public[a];
+			switch (this->status[a]) {
+				case HEALTHY:
+					++(public_a ? population.healthy_in_public : population.healthy_at_home);
+					break;
+				case ASYMPTOMATIC:
+					++(public_a ? population.asymptomatic_in_public : population.asymptomatic_at_home);
+					if (public_a) ++population.incubating[min<unsigned int>(this->days_in_state[a], this->incubation_period)];
+					break;
+				case MILDLY_SYMPTOMATIC:
+					++(public_a ? population.ms_in_public : population.ms_at_home);
+					break;
+				case SEVERELY_SYMPTOMATIC:
+					if (this->bed[a] >= 0) {
+						++population.ss_in_bed;
+						++population.ss_in_bed_by_day[min<unsigned int>(this->day - this->hospital_day[a], population.ss_in_bed_by_day.Days() - 1)];
+					}
+					else {
+						// Population ages its waiting at the end of the day they started waiting
+						++population.ss_waiting_for_bed;
+						++population.ss_waiting_by_day[min<unsigned int>(this->day - this->hospital_day[a] + 1, population.ss_waiting_by_day.Days() - 1)];
+					}
+					break;
+				case DEAD:
+					++population.dead;
+					break;
+			}
+		}
+		return population;
+	}
+
+	series_values_t Series() const{
+		return this->Compartments().Series();
+	}
+
+	void Report() const{
+		this->Compartments().Report();
+	}
+
+	// Saves or restores the whole state, see checkpoint.h
+	template <class Archive>
+	void Checkpoint(Archive& archive){
+		archive.Value(this->day);
+		archive.Value(this->total_population);
+		archive.Value(this->incubation_period);
+		archive.Value(this->is_infectious_since_day);
+		archive.Value(this->average_daily_interactions);
+		this->probability_of.Checkpoint(archive);
+		this->threshold_of = thresholds_t(this->probability_of);
+		archive.Value(this->seed);
+		archive.Value(this->replicate);
+		archive.Value(this->status);
+		archive.Value(this->days_in_state);
+		archive.Value(this->in_public);
+		archive.Value(this->bed);
+		archive.Value(this->hospital_day);
+		archive.Value(this->number_of_hospital_beds);
+		archive.Value(this->free_beds);
+	}
+
+private:
+	unsigned int number_of_hospital_beds;
+	vector<int32_t> free_beds;
+	// Scratch column of agents taking part in today's interactions
+	vector<uint32_t> pool;
+	// Scratch column of agents waiting for a bed
+	vector<uint32_t> waiting;
+
+	bool IsInfectious(uint32_t a) const{
+		return (this->status[a] == ASYMPTOMATIC && this->days_in_state[a] >= this->is_infectious_since_day)
+			|| this->status[a] == MILDLY_SYMPTOMATIC;
+	}
+
+	void ChangeStatus(uint32_t a, status_t status){
+		this->status[a] = status;
+		this->days_in_state[a] = 0;
+		// Only the agents coming from home or public change to severe symptoms, so they start waiting for a bed
+		if (status == SEVERELY_SYMPTOMATIC) this->hospital_day[a] = this->day;
+	}
+
+	void Discharge(uint32_t a, status_t status){
+		this->free_beds.push_back(this->bed[a]);
+		this->bed[a] = -1;
+		this->ChangeStatus(a, status);
+	}
+};
+
+/* Continuous time counterpart of Population, simulated exactly event by event (Gillespie's SSA) or in leaps
+ * - The compartments of Population are the compartments of a ReactionNetwork, every day of the incubation
+ *   period and of a hospital stay is a stage left at rate 1 per day, so it lasts a day on average
+ * - An outcome with the daily chance p happens at rate p per day, which keeps the average time until it happens
+ *   at 1/p days as in the daily engines
+ * - Healthy people in public get exposed with the chance of MeanFieldPopulation for the current number of
+ *   infectious people, which changes with every event instead of once a day
+ * - The severely symptomatic are admitted the moment a bed is free
+ * - Events are drawn by the NextReactionMethod (engine ssa) or TauLeaping (engine tau) with the random numbers
+ *   of the day they are drawn on, the series are the state at the end of every day */
+class ReactionPopulation {
+public:
+	// Compartments before the incubation and hospital stages
+	enum compartment_t : unsigned int { HEALTHY_IN_PUBLIC, HEALTHY_AT_HOME, ASYMPTOMATIC_AT_HOME, MS_IN_PUBLIC, MS_AT_HOME,
+										WAITING_FOR_BED, FREE_BEDS, DEAD, N_OF_FIXED_COMPARTMENTS };
+	enum reaction_kind_t : uint8_t { INFECTION, SCARE, PROGRESS, DEATH, ADMISSION };
+
+	unsigned int day;
+	unsigned int total_population, incubation_period, is_infectious_since_day, average_daily_interactions;
+	probabilities_t probability_of;
+	engine_t engine = engine_t::ssa;
+	uint64_t seed = 0;
+	unsigned int replicate = 0;
+	// Random draws and events so far, for the metrics
+	phase_counters_t counted;
+	// People in every compartment, the incubation stages and then the stages of a hospital stay follow the fixed ones
+	vector<int64_t> counts;
+
+	ReactionPopulation(unsigned int total_population,
+					   unsigned int incubation_period,
+					   unsigned int initial_number_of_sick,
+					   unsigned int is_infectious_since_day,
+					   unsigned int average_daily_interactions,
+					   unsigned int number_of_hospital_beds)
+					   {
+		this->day = 0;
+		this->total_population = total_population;
+		this->incubation_period = incubation_period-1;
+		this->is_infectious_since_day = is_infectious_since_day-1;
+		this->average_daily_interactions = average_daily_interactions;
+
+		this->counts.assign(this->Bed(0) + this->probability_of.HospitalDays(), 0);
+		this->counts[HEALTHY_IN_PUBLIC] = (int64_t)total_population - initial_number_of_sick;
+		this->counts[FREE_BEDS] = number_of_hospital_beds;
+		// Patients 0 start their incubation period in public
+		this->counts[this->Incubating(0)] = initial_number_of_sick;
+		this->Build();
+	}
+
+	void SetProbabilities(const probabilities_t& probabilities){
+		this->probability_of = probabilities;
+		// Stays longer than the days with their own chances are counted in the last stage
+		const size_t stages = this->Bed(0) + probabilities.HospitalDays();
+		for (size_t c = stages; c < this->counts.size(); ++c) this->counts[stages - 1] += this->counts[c];
+		this->counts.resize(stages, 0);
+		this->Build();
+	}
+
+	// Rate of reaction r in the current state, see NextReactionMethod
+	double Propensity(unsigned int r) const{
+		const double propensity = this->rates[r] * this->counts[this->sources[r]];
+		if (this->kinds[r] == INFECTION || this->kinds[r] == SCARE) return propensity * this->Exposure();
+		return propensity;
+	}
+
+	/* Fires every event of the day
+	 * - All kinds of events interleave within a day, so they are measured together as the interactions */
+	void AdvanceDay(RunMetrics* metrics = nullptr){
+		++this->day;
+		if (metrics) metrics->StartDay(this->day);
+		Measured(metrics, METRIC_INTERACTIONS, this->counted, [this]{ this->React(); });
+	}
+
+	/* Counts the compartments and stages into the compartments of Population */
+	Population Compartments() const{
+		Population population = Population(this->total_population, this->incubation_period + 1, 0,
+										   this->is_infectious_since_day + 1, this->average_daily_interactions, 0);
+		population.day = this->day;
+		population.SetProbabilities(this->probability_of);
+		population.healthy_in_public = this->counts[HEALTHY_IN_PUBLIC];
+		population.healthy_at_home = this->counts[HEALTHY_AT_HOME];
+		population.asymptomatic_at_home = this->counts[ASYMPTOMATIC_AT_HOME];
+		population.asymptomatic_in_public = 0;
+		for (unsigned int stage = 0; stage <= this->incubation_period; ++stage) {
+			population.incubating[stage] = this->counts[this->Incubating(stage)];
+			population.asymptomatic_in_public += this->counts[this->Incubating(stage)];
+		}
+		population.ms_in_public = this->counts[MS_IN_PUBLIC];
+		population.ms_at_home = this->counts[MS_AT_HOME];
+		population.ss_waiting_for_bed = population.ss_waiting_by_day[0] = this->counts[WAITING_FOR_BED];
+		population.ss_in_bed = 0;
+		for (unsigned int stage = 0; stage < this->probability_of.HospitalDays(); ++stage) {
+			population.ss_in_bed_by_day[stage] = this->counts[this->Bed(stage)];
+			population.ss_in_bed += this->counts[this->Bed(stage)];
+		}
+		population.available_hospital_beds = this->counts[FREE_BEDS];
+		population.dead = this->counts[DEAD];
+		return population;
+	}
+
+	series_values_t Series() const{
+		return this->Compartments().Series();
+	}
+
+	void Report() const{
+		this->Compartments().Report();
+	}
+
+	// Saves or restores the whole state, see checkpoint.h
+	template <class Archive>
+	void Checkpoint(Archive& archive){
+		archive.Value(this->day);
+		archive.Value(this->total_population);
+		archive.Value(this->incubation_period);
+		archive.Value(this->is_infectious_since_day);
+		archive.Value(this->average_daily_interactions);
+		this->probability_of.Checkpoint(archive);
+		archive.Value(this->seed);
+		archive.Value(this->replicate);
+		archive.Value(this->counts);
+		archive.Value(this->started);
+		this->Build();
+		vector<double> times = this->started ? this->method.FiringTimes() : vector<double>();
+		archive.Value(times);
+		if (this->started && times.size() == this->network.Reactions()) {
+			this->method.Restore(this->network, *this, this->day, times);
+		}
+	}
+
+private:
+	ReactionNetwork network;
+	NextReactionMethod method;
+	TauLeaping leaping;
+	bool started = false;
+	// Propensity of a reaction is its rate times the people in its source compartment
+	// (times the chance of exposure for the infections)
+	vector<double> rates;
+	vector<unsigned int> sources;
+	vector<uint8_t> kinds;
+	unsigned int admission = 0;
+
+	unsigned int Incubating(unsigned int stage) const { return N_OF_FIXED_COMPARTMENTS + stage; }
+	unsigned int Bed(unsigned int stage) const { return N_OF_FIXED_COMPARTMENTS + this->incubation_period + 1 + stage; }
+
+	/* Chance of a healthy person in public to meet an infectious person in their circle today
+	 * - Computed as in MeanFieldPopulation::CalculateInteractions */
+	double Exposure() const{
+		double available_infectious = this->counts[MS_IN_PUBLIC];
+		for (unsigned int stage = this->is_infectious_since_day; stage <= this->incubation_period; ++stage) {
+			available_infectious += this->counts[this->Incubating(stage)];
+		}
+		const double available = this->counts[HEALTHY_IN_PUBLIC] + available_infectious;
+		const double others_in_group = min((double)this->average_daily_interactions, available) - 1.0;
+		if (this->counts[HEALTHY_IN_PUBLIC] <= 0 || available_infectious <= 0.0 || others_in_group < 0.0) return 0.0;
+
+		double no_infectious_met;
+		if (available - 1.0 - available_infectious < others_in_group) {
+			no_infectious_met = 0.0;
+		}
+		else {
+			no_infectious_met = exp(lgamma(available - available_infectious) - lgamma(available - available_infectious - others_in_group)
+									- lgamma(available) + lgamma(available - others_in_group));
+		}
+		return 1.0 - no_infectious_met;
+	}
+
+	void Add(reaction_kind_t kind, unsigned int source, double rate, vector<pair<unsigned int, int64_t>> changes){
+		reaction_t reaction;
+		reaction.reads.push_back(source);
+		if (kind == INFECTION || kind == SCARE) {
+			reaction.reads.push_back(MS_IN_PUBLIC);
+			for (unsigned int stage = this->is_infectious_since_day; stage <= this->incubation_period; ++stage) {
+				reaction.reads.push_back(this->Incubating(stage));
+			}
+		}
+		reaction.changes = move(changes);
+		reaction.changes.emplace(reaction.changes.begin(), source, -1);
+		this->network.Add(reaction);
+		this->rates.push_back(rate);
+		this->sources.push_back(source);
+		this->kinds.push_back(kind);
+	}
+
+	/* Rebuilds the network for the current chances and number of stages */
+	void Build(){
+		const probabilities_t& p = this->probability_of;
+		this->network = ReactionNetwork(this->counts.size());
+		this->rates.clear();
+		this->sources.clear();
+		this->kinds.clear();
+
+		// The exposed get infected in public or at home, or go home healthy
+		this->Add(INFECTION, HEALTHY_IN_PUBLIC, p.getting_sick * (1.0 - p.healthy_staying_home), {{this->Incubating(0), 1}});
+		this->Add(INFECTION, HEALTHY_IN_PUBLIC, p.getting_sick * p.healthy_staying_home, {{ASYMPTOMATIC_AT_HOME, 1}});
+		this->Add(SCARE, HEALTHY_IN_PUBLIC, (1.0 - p.getting_sick) * p.healthy_staying_home, {{HEALTHY_AT_HOME, 1}});
+
+		// Incubation stages, after the last one mild or severe symptoms
+		for (unsigned int stage = 0; stage < this->incubation_period; ++stage) {
+			this->Add(PROGRESS, this->Incubating(stage), 1.0, {{this->Incubating(stage + 1), 1}});
+		}
+		const unsigned int last = this->Incubating(this->incubation_period);
+		this->Add(PROGRESS, last, p.mild_symptoms * (1.0 - p.ms_staying_home), {{MS_IN_PUBLIC, 1}});
+		this->Add(PROGRESS, last, p.mild_symptoms * p.ms_staying_home, {{MS_AT_HOME, 1}});
+		this->Add(PROGRESS, last, 1.0 - p.mild_symptoms, {{WAITING_FOR_BED, 1}});
+
+		// Daily reevaluation of the mildly symptomatic in public, staying mild in public changes nothing
+		this->Add(PROGRESS, MS_IN_PUBLIC, p.mild_symptoms * p.ms_staying_home, {{MS_AT_HOME, 1}});
+		this->Add(PROGRESS, MS_IN_PUBLIC, 1.0 - p.mild_symptoms, {{WAITING_FOR_BED, 1}});
+
+		// Home quarantine ends after a day on average
+		for (unsigned int home : {ASYMPTOMATIC_AT_HOME, MS_AT_HOME}) {
+			this->Add(PROGRESS, home, p.home_recovery, {{HEALTHY_IN_PUBLIC, 1}});
+			this->Add(PROGRESS, home, 1.0 - p.home_recovery, {{WAITING_FOR_BED, 1}});
+		}
+
+		// Hospital stages with their own chances, the last one lasts until recovery or death
+		const unsigned int hospital_days = p.HospitalDays();
+		for (unsigned int stage = 0; stage < hospital_days; ++stage) {
+			const unsigned int bed = this->Bed(stage);
+			const double recovery = p.HospitalRecovery(stage), death = p.HospitalDeath(stage);
+			this->Add(PROGRESS, bed, recovery * (1.0 - p.post_recovery_paranoia), {{HEALTHY_IN_PUBLIC, 1}, {FREE_BEDS, 1}});
+			this->Add(PROGRESS, bed, recovery * p.post_recovery_paranoia, {{HEALTHY_AT_HOME, 1}, {FREE_BEDS, 1}});
+			this->Add(DEATH, bed, death, {{DEAD, 1}, {FREE_BEDS, 1}});
+			if (stage + 1 < hospital_days) this->Add(PROGRESS, bed, 1.0, {{this->Bed(stage + 1), 1}});
+		}
+
+		// Admissions never fire on their own, they follow the events freeing a bed or bringing a patient
+		this->admission = this->network.Reactions();
+		this->Add(ADMISSION, WAITING_FOR_BED, 0.0, {{FREE_BEDS, -1}, {this->Bed(0), 1}});
+	}
+
+	// Admits the waiting while there are free beds, returns whether anyone was admitted
+	bool Admit(){
+		const int64_t admitted = min(this->counts[WAITING_FOR_BED], this->counts[FREE_BEDS]);
+		if (admitted <= 0) return false;
+		this->network.Fire(this->admission, this->counts, admitted);
+		this->counted.admissions += admitted;
+		return true;
+	}
+
+	void Fire(unsigned int r, int64_t times){
+		this->network.Fire(r, this->counts, times);
+		if (this->kinds[r] == INFECTION) this->counted.infections += times;
+		else if (this->kinds[r] == DEATH) this->counted.deaths += times;
+	}
+
+	void React(){
+		RandomStream rng(this->seed, this->replicate, this->day, phase_t::reactions);
+		if (this->engine == engine_t::tau) {
+			this->leaping.RunUntil(this->network, *this, this->counts, this->day - 1.0, this->day, rng,
+								   [&](unsigned int r, int64_t times){
+				this->Fire(r, times);
+				this->Admit();
+			});
+			this->counted.draws += rng.Draws();
+			return;
+		}
+
+		const vector<unsigned int>& admitted = this->network.Dependents(this->admission);
+		if (!this->started) {
+			this->method.Start(this->network, *this, this->day - 1.0, rng);
+			this->started = true;
+			if (this->Admit()) this->method.Refresh(admitted, this->admission, *this, rng);
+		}
+		this->method.RunUntil(this->network, *this, this->day, rng, [&](unsigned int r){
+			this->Fire(r, 1);
+			if (this->Admit()) this->method.Refresh(admitted, this->admission, *this, rng);
+		});
+		this->counted.draws += rng.Draws();
+	}
+};
+
+/* Collects the series of many independent replicates and summarizes them per day
+ * - Replicates store their values directly as their days complete, no per day snapshots are kept
+ * - Each replicate owns its own slots, so replicates can be added from multiple threads at once
+ * - The summary holds the mean, median and the 5th, 25th, 75th and 95th percentile of each series */
+class Ensemble {
+public:
+	Ensemble(unsigned int n_of_replicates, unsigned int n_of_days)
+		: n_of_replicates(n_of_replicates), n_of_days(n_of_days),
+		  samples((size_t)n_of_replicates * n_of_days * N_OF_SERIES, 0.0) {}
+
+	// Stores all days of the replicate's trajectory
+	void Add(unsigned int replicate, const TimeSeriesStore& trajectory){
+		for (unsigned int s = 0; s < N_OF_SERIES; ++s) {
+			const column_view_t column = trajectory.Column(s, 0, this->n_of_days);
+			for (unsigned int day = 0; day < column.size(); ++day) {
+				this->samples[((size_t)day * N_OF_SERIES + s) * this->n_of_replicates + replicate] = column[day];
+			}
+		}
+	}
+
+	bool Write(const string& filename) const{
+		ofstream file(filename);
+		if (!file.is_open()) return false;
+
+		file << "# Day";
+		for (unsigned int s = 0; s < N_OF_SERIES; ++s) {
+			for (const char* statistic : {"mean", "median", "p5", "p25", "p75", "p95"}) {
+				file << " " << series_names[s] << "_" << statistic;
+			}
+		}
+		file << "\n" << fixed << setprecision(2);
+
+		vector<double> sorted(this->n_of_replicates);
+		for (unsigned int day = 0; day < this->n_of_days; ++day) {
+			file << day + 1;
+			for (unsigned int s = 0; s < N_OF_SERIES; ++s) {
+				const double* replicates = &this->samples[((size_t)day * N_OF_SERIES + s) * this->n_of_replicates];
+				sorted.assign(replicates, replicates + this->n_of_replicates);
+				sort(sorted.begin(), sorted.end());
+
+				double sum = 0.0;
+				for (double value : sorted) sum += value;
+				file << " " << sum / this->n_of_replicates
+					 << " " << Percentile(sorted, 0.50)
+					 << " " << Percentile(sorted, 0.05)
+					 << " " << Percentile(sorted, 0.25)
+					 << " " << Percentile(sorted, 0.75)
+					 << " " << Percentile(sorted, 0.95);
+			}
+			file << "\n";
+		}
+		return true;
+	}
+
+private:
+	unsigned int n_of_replicates, n_of_days;
+	// Indexed by [day][series][replicate]
+	vector<double> samples;
+
+	// Linear interpolation between the closest ranks of the sorted values
+	static double Percentile(const vector<double>& sorted, double fraction){
+		double rank = fraction * (double)(sorted.size() - 1);
+		size_t lower = (size_t)rank;
+		if (lower + 1 >= sorted.size()) return sorted.back();
+		return sorted[lower] + (rank - (double)lower) * (sorted[lower + 1] - sorted[lower]);
+	}
+};
+
+void PrintHelp(){
+	cout << "========== Help message for infection progress simulator ==========" << endl
+		 << " Arguments:" << endl
+		 << "   - simDays              Simulation length in days" << endl
+		 << "   - population           Total population" << endl
+		 << "   - initSick             Number of sick people on the first simulation day" << endl
+		 << "   - incubPeriod          Incubation period (after which people develop mild or severe symptoms)" << endl
+		 << "   - infectSince          Number of incubation days passed for the person to be infectious" << endl
+		 << "   - avgDailyInter        Number of random people that meet every day" << endl
+		 << "   - hospCap              Total number of hospital beds available" << endl
+		 << "   - CgetSick             Chance of getting infected after meeting an infectious person (in %)" << endl
+		 << "   - ChealthyAtHome       Chance of staying at home as a precaution after meeting an infectious person (in %)" << endl
+		 << "   - CmildSympt           Chance of developing mild symptoms after the incubation period (in %)" << endl
+		 << "   - CmildSymAtHome       Chance of staying at home when having mild symptoms (in %)" << endl
+		 << "   - ChospitalRec         Chance of recovery when hospitalized (in %)" << endl
+		 << "   - ChospitalDeath       Chance of dying when hospitalized (in %)" << endl
+		 << "   - ChomeRec             Chance of recovering in home isolation (in %)" << endl
+		 << "   - Cprp                 Chance of post recovery paranoia (staying at home until the end of the simulation) (in %)" << endl
+		 << "   - ChospitalRecByDay    Comma separated ChospitalRec for the 1st, 2nd, ... day in a hospital bed," << endl
+		 << "                          the last one applies to all longer stays (replaces ChospitalRec)" << endl
+		 << "   - ChospitalDeathByDay  Comma separated ChospitalDeath for the 1st, 2nd, ... day in a hospital bed," << endl
+		 << "                          the last one applies to all longer stays (replaces ChospitalDeath)" << endl
+		 << "   - icuCap               Intensive care beds on top of hospCap, ward patients who need intensive care move" << endl
+		 << "                          there while beds are free (individual and aggregate engine, 0 = no intensive care)" << endl
+		 << "   - CstepUpByDay         Comma separated chances of a ward patient needing intensive care on the 1st, 2nd, ..." << endl
+		 << "                          day in the ward, the last one applies to all longer stays (in %, 5 by default)" << endl
+		 << "   - CicuRecByDay         Comma separated chances of recovery on the 1st, 2nd, ... day in intensive care (12 by default)" << endl
+		 << "   - CicuDeathByDay       Comma separated chances of dying on the 1st, 2nd, ... day in intensive care (6 by default)" << endl
+		 << "   - seed                 Seed of the random number streams (same seed gives the same results)" << endl
+		 << "   - engine               How the population is advanced: 'individual' (per person, default), 'aggregate' (per compartment)," << endl
+		 << "                          'deterministic' (expected values), 'agent' (every person is an agent with their own state)" << endl
+		 << "                          'ssa' (exact continuous time simulation, event by event) or 'tau' (the same model" << endl
+		 << "                          advanced in adaptive leaps of many events, for large populations)" << endl
+		 << "   - deterministic        Same as engine=deterministic: writes the expected trajectory into data.dat" << endl
+		 << "   - regions              File with lines 'name population initSick hospCap' simulated as coupled regions (at most 65536)" << endl
+		 << "                          (per region results in regions.dat, their sum in data.dat or the binary and jsonl files)" << endl
+		 << "   - mobility             File with lines 'origin destination share', share being the % of the origin's healthy and" << endl
+		 << "                          infectious people in public who mix into the destination's interaction circles every day" << endl
+		 << "   - replicates           Number of independent runs summarized into ensemble.dat (instead of data.dat)" << endl
+		 << "   - binary               Binary file the days are streamed into as they complete (instead of data.dat)," << endl
+		 << "                          with replicates every replicate's days are stored next to ensemble.dat" << endl
+		 << "   - export               Converts a binary file of a single run (or its first replicate) into data.dat" << endl
+		 << "   - jsonl                File every simulated day is written into as a JSON object on its own line" << endl
+		 << "                          (with replicates the days of every replicate)" << endl
+		 << "   - checkpoint-every     Saves the state of a single run every N days, so it can be resumed after a crash" << endl
+		 << "   - checkpoint           File the checkpoints are saved into (checkpoint.bin by default)" << endl
+		 << "   - resume               Continues a single run from a checkpoint up to simDays, exactly as if never interrupted" << endl
+		 << "                          (the population and its chances come from the checkpoint)" << endl
+		 << "   - scenario             NAME=VALUE[;NAME=VALUE...] chances of a scenario forked from the main run (repeatable)," << endl
+		 << "                          all scenarios are written into scenarios.dat" << endl
+		 << "   - fork                 Day after which the scenarios diverge, the days up to it are simulated once and shared" << endl
+		 << "   - events               Binary file the latest simulation events of every thread are dumped into at exit" << endl
+		 << "                          (needs a build recording events, e.g. make main-events)" << endl
+		 << "   - eventSample          Keeps only every Nth event of a thread (1 by default)" << endl
+		 << "   - eventRing            Number of latest events kept per thread (65536 by default)" << endl
+		 << "   - eventDump            Prints an events file as text" << endl
+		 << "   - metrics-json         File the time, random draws and events of every phase of a single run are written" << endl
+		 << "                          into as JSON, per day and in total" << endl
+		 << "   - perf                 Counts cycles, instructions, branch and cache misses of every phase of a single run" << endl
+		 << "                          (Linux only) and prints them after the run, into the metrics file as well if given" << endl
+		 << "   - interactionPools     Number of pools (1-255) the daily interactions are split into and formed in parallel" << endl
+		 << "                          on threads threads (individual and aggregate engine, 1 = one serial pass)" << endl
+		 << "   - closedForm           Draws the outcome of the daily interactions in closed form instead of forming every" << endl
+		 << "                          circle (individual and aggregate engine, an approximation for large avgDailyInter)" << endl
+		 << "   - compareClosedForm    Compares the closed form with the circles over N draws of the interactions of every" << endl
+		 << "                          simulated day into closedform.dat and prints their differences" << endl
+		 << "   - schedule             File of changes of the chances, avgDailyInter and hospCap during the run, one per line:" << endl
+		 << "                          'DAY NAME VALUE' from DAY on, 'FIRST:LAST NAME VALUE' ramping linearly up to LAST," << endl
+		 << "                          'when QUANTITY >|< X NAME VALUE' from the day after QUANTITY (a data.dat column," << endl
+		 << "                          ss_waiting_for_bed or ss_in_bed) crossed X, triggers firing once in the file's order" << endl
+		 << "                          (individual and aggregate engine)" << endl
+		 << "   - threads              Number of threads running the replicates (0 uses all available cores)" << endl
+		 << "   - sweep                NAME=VALUES runs every combination of the values of the swept options into sweep.dat," << endl
+		 << "                          VALUES being a comma separated list of values and from:to[:step] ranges (repeatable)" << endl
+		 << "  When an argument is not used it is All arguments have to have a whole positive number as a value." << endl
+		 << endl
+		 << " Chances deduced from chance arguments:" << endl
+	  	 << "   * 100% - CgetSick%" << endl
+	  	 << "	          -> Chance of staying healthy after meeting an infectious person" << endl
+	  	 << "   * 100% - ChealthyAtHome%" << endl
+	  	 << "	          -> Chance of staying in public after meeting an infectious person" << endl
+	  	 << "   * 100% - CmildSympt%" << endl
+	  	 << "	          -> Chance of developing severe symptoms after the incubation periodand going to the hospital" << endl
+	  	 << "   * 100% - CmildSymAtHome%" << endl
+	  	 << "	          -> Chance of staying in public after developing mild symptoms" << endl
+	  	 << "   * 100% - ChospitalRec% - ChospitalDeath%" << endl
+	  	 << "	          -> Chance of staying healthy after meeting an infectious person" << endl
+	  	 << "   * 100% - ChomeRec%" << endl
+	  	 << "	          -> Chance of developing severe symptoms at home and going to the hospital" << endl
+	  	 << "   * 100% - Cprp%" << endl
+	  	 << "	          -> Chance of staying in public after recovering" << endl
+	  	 << endl;
+}
+
+class Schedule;
+
+/* Everything that can be set from the command line, with the default scenario as initial values */
+struct settings_t {
+	unsigned int number_of_simulation_days = 7;
+
+	unsigned int total_population = 1324277;
+	unsigned int initial_number_of_sick = 6834; // Number of patients 0
+	unsigned int incubation_period = 5; // Number of days before symptoms appear
+	unsigned int is_infectious_since_day = 4; // On which incubation day the person becomes infectious
+	unsigned int average_daily_interactions = 2000; // Size of the daily interaction circle
+	unsigned int hospital_capacity = 836; // Number of total available hospital beds
+	engine_t engine = engine_t::individual;
+	uint64_t seed = 0;
+	unsigned int number_of_replicates = 1;
+	unsigned int number_of_threads = 0;
+	string regions_file, mobility_file;
+	string binary_file, export_file, jsonl_file;
+	unsigned int checkpoint_every = 0;
+	string checkpoint_file = "checkpoint.bin", resume_file;
+	unsigned int fork_day = 0;
+	string events_file, events_dump_file;
+	unsigned int event_sample = 1, event_ring = 65536;
+	string metrics_file;
+	bool perf_counters = false;
+	unsigned int interaction_pools = 1;
+	bool closed_form_interactions = false;
+	unsigned int closed_form_trials = 0;
+	unsigned int icu_capacity = 0; // Number of intensive care beds on top of hospCap
+	shared_ptr<const Schedule> schedule; // Changes of the parameters during the run
+
+	probabilities_t probability_of;
+
+	settings_t(){
+		probability_of.getting_sick = 0.10;	// Chance of catching it from an infectious person they met
+		probability_of.healthy_staying_home = 0.05; // Chance of prevention by self quarantine
+		probability_of.mild_symptoms = 0.80; // Chance of developing mild symptoms after passing the incubation period (Leaving 20% chance to develop severe symptoms)
+		probability_of.ms_staying_home = 0.95; // Chance of self quarantine after developing mild symptoms (Leaving 5% chance of staying in public)
+
+		probability_of.hospital_recovery = 0.90;
+		probability_of.hospital_death = 0.03;
+		// Leaving 7% chance to stay in hospital for another day
+
+		probability_of.home_recovery = 0.90;
+		// Leaving 60% chance of needing hospitalization
+
+		probability_of.post_recovery_paranoia = 0.15;
+		// Leaving 85% chance of self quarantine after overcoming the illness
+
+		probability_of.icu_step_up_by_day = {0.05}; // Chance of a ward patient needing intensive care on any day
+		probability_of.icu_recovery_by_day = {0.12};
+		probability_of.icu_death_by_day = {0.06};
+		// Leaving 82% chance to stay in intensive care for another day
+	}
+};
+
+const option long_opts[] = {
+		{"simDays", required_argument, nullptr, 'a'},
+		{"population", required_argument, nullptr, 'b'},
+		{"initSick", required_argument, nullptr, 'c'},
+		{"incubPeriod", required_argument, nullptr, 'd'},
+		{"infectSince", required_argument, nullptr, 'e'},
+		{"avgDailyInter", required_argument, nullptr, 'f'},
+		{"hospCap", required_argument, nullptr, 'g'},
+		{"CgetSick", required_argument, nullptr, 'q'},
+		{"ChealthyAtHome", required_argument, nullptr, 'i'},
+		{"CmildSympt", required_argument, nullptr, 'j'},
+		{"CmildSymAtHome", required_argument, nullptr, 'k'},
+		{"ChospitalRec", required_argument, nullptr, 'l'},
+		{"ChospitalDeath", required_argument, nullptr, 'm'},
+		{"ChomeRec", required_argument, nullptr, 'n'},
+		{"Cprp", required_argument, nullptr, 'p'},
+		{"ChospitalRecByDay", required_argument, nullptr, 'o'},
+		{"ChospitalDeathByDay", required_argument, nullptr, 'z'},
+		{"engine", required_argument, nullptr, 'r'},
+		{"seed", required_argument, nullptr, 's'},
+		{"replicates", required_argument, nullptr, 't'},
+		{"threads", required_argument, nullptr, 'u'},
+		{"sweep", required_argument, nullptr, 'v'},
+		{"deterministic", no_argument, nullptr, 'w'},
+		{"regions", required_argument, nullptr, 'x'},
+		{"mobility", required_argument, nullptr, 'y'},
+		{"binary", required_argument, nullptr, 'B'},
+		{"export", required_argument, nullptr, 'E'},
+		{"jsonl", required_argument, nullptr, 'J'},
+		{"checkpoint-every", required_argument, nullptr, 'K'},
+		{"checkpoint", required_argument, nullptr, 'C'},
+		{"resume", required_argument, nullptr, 'R'},
+		{"fork", required_argument, nullptr, 'F'},
+		{"scenario", required_argument, nullptr, 'S'},
+		{"events", required_argument, nullptr, 'G'},
+		{"eventSample", required_argument, nullptr, 'N'},
+		{"eventRing", required_argument, nullptr, 'L'},
+		{"eventDump", required_argument, nullptr, 'D'},
+		{"metrics-json", required_argument, nullptr, 'M'},
+		{"perf", no_argument, nullptr, 'P'},
+		{"interactionPools", required_argument, nullptr, 'I'},
+		{"closedForm", no_argument, nullptr, 'A'},
+		{"schedule", required_argument, nullptr, 'T'},
+		{"icuCap", required_argument, nullptr, 'H'},
+		{"CstepUpByDay", required_argument, nullptr, 'U'},
+		{"CicuRecByDay", required_argument, nullptr, 'V'},
+		{"CicuDeathByDay", required_argument, nullptr, 'W'},
+		{"compareClosedForm", required_argument, nullptr, 'X'},
+		{"help", no_argument, nullptr, 'h'},
+		{nullptr, no_argument, nullptr, 0}
+};
+
+// Parses a comma separated list of chances in % (throws invalid_argument when malformed)
+vector<float> ParseChances(const string& value){
+	vector<float> chances;
+	stringstream list(value);
+	string chance;
+	while (getline(list, chance, ',')) {
+		chances.push_back((float)(std::stoi(chance))/100);
+	}
+	if (chances.empty()) throw invalid_argument(value);
+	return chances;
+}
+
+/* Sets a value of the option with the given getopt code
+ * - Returns false when the code is not a setting or the value is invalid */
+bool ApplyOption(settings_t& settings, int opt, const string& value){
+	try {
+		switch (opt)
+		{
+			case 'a':
+				settings.number_of_simulation_days = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Number of simulation days set to: " << settings.number_of_simulation_days << endl;);
+				break;
+			case 'b':
+				settings.total_population = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Total population set to: " << settings.total_population << endl;);
+				break;
+			case 'c':
+				settings.initial_number_of_sick = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Initial number of sick set to: " << settings.initial_number_of_sick << std::endl;);
+				break;
+			case 'd':
+				settings.incubation_period = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Incubation period set to: " << settings.incubation_period << std::endl;);
+				break;
+			case 'e':
+				settings.is_infectious_since_day = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Infectious since day X set to: " << settings.is_infectious_since_day << std::endl;);
+				break;
+			case 'f':
+				settings.average_daily_interactions = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Average daily interactions set to: " << settings.average_daily_interactions << std::endl;);
+				break;
+			case 'g':
+				settings.hospital_capacity = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Hospital bed capacity set to: " << settings.hospital_capacity << std::endl;);
+				break;
+			case 'q':
+				settings.probability_of.getting_sick = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of getting sick set to: " << settings.probability_of.getting_sick*100 << "%" << std::endl;);
+				break;
+			case 'i':
+				settings.probability_of.healthy_staying_home = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of healthy people isolating set to: " << settings.probability_of.healthy_staying_home*100 << "%" << std::endl;);
+				break;
+			case 'j':
+				settings.probability_of.mild_symptoms = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of developing mild symptoms set to: " << settings.probability_of.mild_symptoms*100 << "%" << std::endl;);
+				break;
+			case 'k':
+				settings.probability_of.ms_staying_home = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of staying home when having mild symptoms set to: " << settings.probability_of.ms_staying_home*100 << "%" << std::endl;);
+				break;
+			case 'l':
+				settings.probability_of.hospital_recovery = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of recovery when hospitalized set to: " << settings.probability_of.hospital_recovery*100 << "%" << std::endl;);
+				break;
+			case 'm':
+				settings.probability_of.hospital_death = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of dying when hospitalized set to: " << settings.probability_of.hospital_death*100 << "%" << std::endl;);
+				break;
+			case 'n':
+				settings.probability_of.home_recovery = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of recovering in home isolation set to: " << settings.probability_of.home_recovery*100 << "%" << std::endl;);
+				break;
+			case 'p':
+				settings.probability_of.post_recovery_paranoia = (float)(std::stoi(value))/100;
+				TRACE(phase_t::setup, std::cout << "Probability of post recovery paranoia set to: " << settings.probability_of.post_recovery_paranoia*100 << "%" << std::endl;);
+				break;
+			case 'o':
+				settings.probability_of.hospital_recovery_by_day = ParseChances(value);
+				TRACE(phase_t::setup, std::cout << "Probability of recovery when hospitalized set for " << settings.probability_of.hospital_recovery_by_day.size() << " days of stay" << std::endl;);
+				break;
+			case 'z':
+				settings.probability_of.hospital_death_by_day = ParseChances(value);
+				TRACE(phase_t::setup, std::cout << "Probability of dying when hospitalized set for " << settings.probability_of.hospital_death_by_day.size() << " days of stay" << std::endl;);
+				break;
+			case 'r':
+				if (value == "individual") settings.engine = engine_t::individual;
+				else if (value == "aggregate") settings.engine = engine_t::aggregate;
+				else if (value == "deterministic") settings.engine = engine_t::deterministic;
+				else if (value == "agent") settings.engine = engine_t::agent;
+				else if (value == "ssa") settings.engine = engine_t::ssa;
+				else if (value == "tau") settings.engine = engine_t::tau;
+				else return false;
+				TRACE(phase_t::setup, std::cout << "Engine set to: " << value << std::endl;);
+				break;
+			case 'w':
+				settings.engine = engine_t::deterministic;
+				TRACE(phase_t::setup, std::cout << "Engine set to: deterministic" << std::endl;);
+				break;
+			case 's':
+				settings.seed = std::stoull(value);
+				TRACE(phase_t::setup, std::cout << "Seed set to: " << settings.seed << std::endl;);
+				break;
+			case 't':
+				settings.number_of_replicates = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Number of replicates set to: " << settings.number_of_replicates << std::endl;);
+				break;
+			case 'u':
+				settings.number_of_threads = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Number of threads set to: " << settings.number_of_threads << std::endl;);
+				break;
+			case 'x':
+				settings.regions_file = value;
+				TRACE(phase_t::setup, std::cout << "Regions loaded from: " << settings.regions_file << std::endl;);
+				break;
+			case 'y':
+				settings.mobility_file = value;
+				TRACE(phase_t::setup, std::cout << "Mobility loaded from: " << settings.mobility_file << std::endl;);
+				break;
+			case 'B':
+				settings.binary_file = value;
+				TRACE(phase_t::setup, std::cout << "Binary output written to: " << settings.binary_file << std::endl;);
+				break;
+			case 'E':
+				settings.export_file = value;
+				TRACE(phase_t::setup, std::cout << "Binary output exported from: " << settings.export_file << std::endl;);
+				break;
+			case 'J':
+				settings.jsonl_file = value;
+				TRACE(phase_t::setup, std::cout << "JSON lines output written to: " << settings.jsonl_file << std::endl;);
+				break;
+			case 'K':
+				settings.checkpoint_every = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Checkpoint saved every " << settings.checkpoint_every << " days" << std::endl;);
+				break;
+			case 'C':
+				settings.checkpoint_file = value;
+				TRACE(phase_t::setup, std::cout << "Checkpoint saved into: " << settings.checkpoint_file << std::endl;);
+				break;
+			case 'R':
+				settings.resume_file = value;
+				TRACE(phase_t::setup, std::cout << "Resuming from: " << settings.resume_file << std::endl;);
+				break;
+			case 'F':
+				settings.fork_day = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Scenarios forked on day: " << settings.fork_day << std::endl;);
+				break;
+			case 'G':
+				settings.events_file = value;
+				TRACE(phase_t::setup, std::cout << "Events dumped into: " << settings.events_file << std::endl;);
+				break;
+			case 'N':
+				settings.event_sample = std::stoul(value);
+				if (settings.event_sample == 0) return false;
+				TRACE(phase_t::setup, std::cout << "Every " << settings.event_sample << ". event kept" << std::endl;);
+				break;
+			case 'L':
+				settings.event_ring = std::stoul(value);
+				if (settings.event_ring == 0) return false;
+				TRACE(phase_t::setup, std::cout << "Events kept per thread: " << settings.event_ring << std::endl;);
+				break;
+			case 'D':
+				settings.events_dump_file = value;
+				TRACE(phase_t::setup, std::cout << "Events printed from: " << settings.events_dump_file << std::endl;);
+				break;
+			case 'M':
+				settings.metrics_file = value;
+				TRACE(phase_t::setup, std::cout << "Metrics written to: " << settings.metrics_file << std::endl;);
+				break;
+			case 'P':
+				settings.perf_counters = true;
+				TRACE(phase_t::setup, std::cout << "Hardware counters enabled" << std::endl;);
+				break;
+			case 'I':
+				settings.interaction_pools = std::stoul(value);
+				if (settings.interaction_pools == 0 || settings.interaction_pools > max_interaction_pools) return false;
+				TRACE(phase_t::setup, std::cout << "Interactions split into pools: " << settings.interaction_pools << std::endl;);
+				break;
+			case 'H':
+				settings.icu_capacity = std::stoul(value);
+				TRACE(phase_t::setup, std::cout << "Intensive care capacity set to: " << settings.icu_capacity << std::endl;);
+				break;
+			case 'U':
+				settings.probability_of.icu_step_up_by_day = ParseChances(value);
+				TRACE(phase_t::setup, std::cout << "Probability of needing intensive care set for " << settings.probability_of.icu_step_up_by_day.size() << " days of stay" << std::endl;);
+				break;
+			case 'V':
+				settings.probability_of.icu_recovery_by_day = ParseChances(value);
+				TRACE(phase_t::setup, std::cout << "Probability of recovery in intensive care set for " << settings.probability_of.icu_recovery_by_day.size() << " days of stay" << std::endl;);
+				break;
+			case 'W':
+				settings.probability_of.icu_death_by_day = ParseChances(value);
+				TRACE(phase_t::setup, std::cout << "Probability of dying in intensive care set for " << settings.probability_of.icu_death_by_day.size() << " days of stay" << std::endl;);
+				break;
+			case 'A':
+				settings.closed_form_interactions = true;
+				TRACE(phase_t::setup, std::cout << "Interactions drawn in closed form" << std::endl;);
+				break;
+			case 'X':
+				settings.closed_form_trials = std::stoul(value);
+				if (settings.closed_form_trials == 0) return false;
+				TRACE(phase_t::setup, std::cout << "Closed form compared over trials per day: " << settings.closed_form_trials << std::endl;);
+				break;
+			default:
+				return false;
+		}
+	}
+	catch (const logic_error&) { return false; }
+	return true;
+}
+
+Population NewPopulation(const settings_t& settings, unsigned int replicate){
+	Population population = Population(settings.total_population, settings.incubation_period, settings.initial_number_of_sick,
+									   settings.is_infectious_since_day, settings.average_daily_interactions, settings.hospital_capacity);
+	population.day = 0;
+	population.SetProbabilities(settings.probability_of);
+	population.engine = settings.engine;
+	population.seed = settings.seed;
+	population.replicate = replicate;
+	population.interaction_pools = settings.interaction_pools;
+	// Replicates already keep the threads busy
+	population.interaction_threads = settings.number_of_replicates > 1 ? 1 : settings.number_of_threads;
+	population.closed_form_interactions = settings.closed_form_interactions;
+	population.SetIntensiveCare(settings.icu_capacity);
+	return population;
+}
+
+MeanFieldPopulation NewMeanFieldPopulation(const settings_t& settings){
+	MeanFieldPopulation population = MeanFieldPopulation(settings.total_population, settings.incubation_period, settings.initial_number_of_sick,
+														 settings.is_infectious_since_day, settings.average_daily_interactions, settings.hospital_capacity);
+	population.SetProbabilities(settings.probability_of);
+	return population;
+}
+
+AgentPopulation NewAgentPopulation(const settings_t& settings, unsigned int replicate){
+	AgentPopulation population = AgentPopulation(settings.total_population, settings.incubation_period, settings.initial_number_of_sick,
+												 settings.is_infectious_since_day, settings.average_daily_interactions, settings.hospital_capacity);
+	population.SetProbabilities(settings.probability_of);
+	population.seed = settings.seed;
+	population.replicate = replicate;
+	return population;
+}
+
+ReactionPopulation NewReactionPopulation(const settings_t& settings, unsigned int replicate){
+	ReactionPopulation population = ReactionPopulation(settings.total_population, settings.incubation_period, settings.initial_number_of_sick,
+													   settings.is_infectious_since_day, settings.average_daily_interactions, settings.hospital_capacity);
+	population.SetProbabilities(settings.probability_of);
+	population.engine = settings.engine;
+	population.seed = settings.seed;
+	population.replicate = replicate;
+	return population;
+}
+
+/* Writes the days of a trajectory into a data.dat like file, one line per day starting with its number
+ * - Reads the series through trajectory.Column(s), so it works for TimeSeriesStore and SeriesFileReader alike
+ * - A negative precision prints whole numbers if all values are whole and two decimals otherwise */
+template <class Trajectory>
+bool WriteTrajectory(const Trajectory& trajectory, const string& filename, int precision){
+	ofstream file(filename);
+	if (!file.is_open()) return false;
+
+	column_view_t columns[N_OF_SERIES];
+	for (unsigned int s = 0; s < N_OF_SERIES; ++s) columns[s] = trajectory.Column(s);
+	if (precision < 0) {
+		precision = 0;
+		for (const column_view_t& column : columns) {
+			for (double value : column) {
+				if (value != floor(value)) precision = 2;
+			}
+		}
+	}
+
+	file << "# Day";
+	for (unsigned int s = 0; s < N_OF_SERIES; ++s) file << " " << series_names[s];
+	file << "\n" << fixed << setprecision(precision);
+	for (unsigned int day = 0; day < columns[0].size(); ++day) {
+		file << day + 1;
+		for (const column_view_t& column : columns) file << " " << column[day];
+		file << "\n";
+	}
+	return true;
+}
+
+/* Values of one simulated day handed to the OutputWriter */
+struct day_record_t {
+	unsigned int replicate = 0, day = 0;
+	// Region of a metapopulation the values belong to, -1 for the whole population
+	int region = -1;
+	series_values_t values;
+	// Trace output printed while simulating the day, empty unless tracing
+	string log;
+};
+
+/* Writes day records into the selected sinks on its own thread, so simulating never waits for disk or terminal I/O
+ * - Every producer thread has its own lock free SpscQueue, the writer thread drains them in turns
+ * - A producer only waits when its queue is full, i.e. when the writer is a whole queue behind
+ * - Sinks: data.dat like text (first replicate only), binary series file, JSON lines and stdout for the trace logs,
+ *   records of regions only go to regions.dat like text */
+class OutputWriter {
+public:
+	// Sinks, empty names are not written
+	string text_file, binary_file, jsonl_file, regions_file;
+	// Names of the regions written into the regions file
+	vector<string> region_names;
+	int precision = 0;
+	// Times the writing of every day when set
+	RunMetrics* metrics = nullptr;
+
+	OutputWriter(unsigned int n_of_producers, size_t queue_capacity) : terminal(cout.rdbuf()){
+		for (unsigned int p = 0; p < n_of_producers; ++p) {
+			this->queues.emplace_back(new SpscQueue<day_record_t>(queue_capacity));
+		}
+	}
+	~OutputWriter(){ this->Finish(); }
+
+	/* Opens the sinks and starts the writer thread
+	 * - Returns false when a file can't be opened */
+	bool Start(unsigned int n_of_replicates, unsigned int n_of_days){
+		if (!this->text_file.empty()) {
+			this->text.open(this->text_file);
+			if (!this->text.is_open()) return false;
+			this->text << "# Day";
+			for (unsigned int s = 0; s < N_OF_SERIES; ++s) this->text << " " << series_names[s];
+			this->text << "\n" << fixed << setprecision(this->precision);
+		}
+		if (!this->binary_file.empty()) {
+			const vector<string> names(series_names, series_names + N_OF_SERIES);
+			if (!this->binary.Open(this->binary_file, names, n_of_replicates, n_of_days)) return false;
+		}
+		if (!this->jsonl_file.empty()) {
+			this->jsonl.open(this->jsonl_file);
+			if (!this->jsonl.is_open()) return false;
+			this->jsonl << fixed << setprecision(this->precision);
+		}
+		if (!this->regions_file.empty()) {
+			this->regions.open(this->regions_file);
+			if (!this->regions.is_open()) return false;
+			this->regions << "# Day Region";
+			for (unsigned int s = 0; s < N_OF_SERIES; ++s) this->regions << " " << series_names[s];
+			this->regions << "\n" << fixed << setprecision(this->precision);
+		}
+		this->writer = thread(&OutputWriter::Run, this);
+		return true;
+	}
+
+	// Hands the record over to the writer thread, leaves it in a moved from state
+	void Push(unsigned int producer, day_record_t& record){
+		if (!this->writer.joinable()) return;
+		while (!this->queues[producer]->TryPush(record)) {
+			this_thread::yield();
+		}
+	}
+
+	// Writes everything pushed so far and stops the writer thread
+	void Finish(){
+		if (!this->writer.joinable()) return;
+		this->finished.store(true, memory_order_release);
+		this->writer.join();
+		this->text.close();
+		this->binary.Close();
+		this->jsonl.close();
+		this->regions.close();
+	}
+
+private:
+	vector<unique_ptr<SpscQueue<day_record_t>>> queues;
+	atomic<bool> finished{false};
+	thread writer;
+	// Where stdout pointed when the writer was created (main may redirect cout to capture the trace logs)
+	streambuf* terminal;
+	ofstream text, jsonl, regions;
+	SeriesFileWriter binary;
+
+	void Run(){
+		day_record_t record;
+		while (true) {
+			// Records pushed before finishing was requested are all visible once it is
+			const bool finishing = this->finished.load(memory_order_acquire);
+			bool written = false;
+			for (auto& queue : this->queues) {
+				while (queue->TryPop(record)) {
+					if (this->metrics) {
+						const RunMetrics::clock::time_point start = RunMetrics::clock::now();
+						this->Write(record);
+						this->metrics->AddOutput(record.day, RunMetrics::Elapsed(start));
+					}
+					else this->Write(record);
+					written = true;
+				}
+			}
+			if (written) {
+				this->terminal->pubsync();
+				continue;
+			}
+			if (finishing) return;
+			this_thread::sleep_for(chrono::microseconds(100));
+		}
+	}
+
+	void Write(const day_record_t& record){
+		if (!record.log.empty()) this->terminal->sputn(record.log.data(), record.log.size());
+		if (record.region >= 0) {
+			if (!this->regions.is_open()) return;
+			this->regions << record.day << " " << this->region_names[record.region];
+			for (double value : record.values) this->regions << " " << value;
+			this->regions << "\n";
+			return;
+		}
+		if (this->text.is_open() && record.replicate == 0) {
+			this->text << record.day;
+			for (double value : record.values) this->text << " " << value;
+			this->text << "\n";
+		}
+		if (this->binary.IsOpen()) this->binary.Append(record.replicate, record.values);
+		if (this->jsonl.is_open()) {
+			this->jsonl << "{\"replicate\":" << record.replicate << ",\"day\":" << record.day;
+			for (unsigned int s = 0; s < N_OF_SERIES; ++s) this->jsonl << ",\"" << series_names[s] << "\":" << record.values[s];
+			this->jsonl << "}\n";
+		}
+	}
+};
+
+/* Time-varying interventions read from a schedule file
+ * - Every line changes one option, a chance, avgDailyInter or hospCap, to a value given as on the command line:
+ *     DAY NAME VALUE                 from day DAY on
+ *     FIRST:LAST NAME VALUE          linearly from the value of day FIRST-1 to VALUE on day LAST
+ *                                    (by-day chances of different lengths switch on day LAST)
+ *     when QUANTITY >|< X NAME VALUE from the day after a day ending with QUANTITY above or below X
+ *   QUANTITY being a column of data.dat, ss_waiting_for_bed or ss_in_bed, '#' starts a comment
+ * - Triggers fire once each and in the order of the file, a trigger is only watched after the one above it fired,
+ *   so a later trigger can lift what an earlier one imposed
+ * - Compile() turns the schedule into a table of the parameters of every day and a fired trigger compiles it
+ *   again, the simulated days only look their parameters up */
+class Schedule {
+public:
+	// Reads the schedule, error says what is wrong with an invalid one
+	bool Load(const string& filename, string& error){
+		ifstream file(filename);
+		if (!file.is_open()) {
+			error = "unable to open " + filename;
+			return false;
+		}
+		string line;
+		for (unsigned int number = 1; getline(file, line); ++number) {
+			line = line.substr(0, line.find('#'));
+			istringstream words(line);
+			string first;
+			if (!(words >> first)) continue;
+
+			entry_t entry;
+			string name, value, extra;
+			try {
+				if (first == "when") {
+					string quantity, comparison;
+					if (!(words >> quantity >> comparison >> entry.threshold)) throw invalid_argument(line);
+					entry.trigger = true;
+					entry.above = comparison == ">";
+					if (!entry.above && comparison != "<") throw invalid_argument(comparison);
+					entry.quantity = ParseQuantity(quantity);
+				}
+				else {
+					const size_t colon = first.find(':');
+					entry.first_day = stoul(first.substr(0, colon));
+					entry.last_day = colon == string::npos ? entry.first_day : stoul(first.substr(colon + 1));
+					if (entry.first_day == 0 || entry.last_day < entry.first_day) throw invalid_argument(first);
+				}
+				if (!(words >> name >> value) || words >> extra) throw invalid_argument(line);
+			}
+			catch (const logic_error&) {
+				error = "line " + to_string(number) + ": " + line;
+				return false;
+			}
+
+			entry.opt = 0;
+			for (const option* o = long_opts; o->name; ++o) {
+				if (name == o->name) entry.opt = o->val;
+			}
+			entry.value = value;
+			settings_t scratch;
+			if (entry.opt == 0 || !strchr(scheduled_options, entry.opt) || !ApplyOption(scratch, entry.opt, value)) {
+				error = "line " + to_string(number) + ": " + name + " " + value;
+				return false;
+			}
+			this->entries.push_back(entry);
+		}
+		return true;
+	}
+
+	bool Empty() const { return this->entries.empty(); }
+
+	/* Parameters of every day of a run of the settings
+	 * - Days before the earliest change keep the parameters of the settings and are not applied at all */
+	void Compile(const settings_t& settings){
+		this->settings = settings;
+		this->days.assign(settings.number_of_simulation_days + 1, day_parameters_t());
+		day_parameters_t& before = this->days[0];
+		before.probability_of = settings.probability_of;
+		before.average_daily_interactions = settings.average_daily_interactions;
+		before.hospital_capacity = settings.hospital_capacity;
+
+		// Parameters a ramp starts from and ends with
+		vector<day_parameters_t> ramp_from(this->entries.size()), ramp_to(this->entries.size());
+		for (unsigned int day = 1; day < this->days.size(); ++day) {
+			day_parameters_t& today = this->days[day];
+			today = this->days[day - 1];
+			today.changed = false;
+			for (size_t e = 0; e < this->entries.size(); ++e) {
+				const entry_t& entry = this->entries[e];
+				// A fired trigger changes its option from the day after it fired
+				const unsigned int first_day = entry.trigger ? entry.fired_day + 1 : entry.first_day;
+				const unsigned int last_day = entry.trigger ? first_day : entry.last_day;
+				if ((entry.trigger && !entry.fired_day) || day < first_day || day > last_day) continue;
+
+				if (day == first_day) {
+					ramp_from[e] = today;
+					ramp_to[e] = this->Changed(today, entry);
+				}
+				if (day == last_day) today = this->Changed(today, entry);
+				else Ramp(today, ramp_from[e], ramp_to[e], (double)(day - first_day + 1) / (last_day - first_day + 1));
+				today.changed = true;
+			}
+		}
+	}
+
+	// Sets the parameters of the day about to be simulated when they changed
+	void Apply(Population& population) const{
+		const unsigned int day = population.day + 1;
+		if (day < this->days.size() && this->days[day].changed) population.ApplyParameters(this->days[day]);
+	}
+
+	// Watches the next trigger after the day the population just simulated, a fired one compiles the schedule again
+	void Observe(const Population& population){
+		while (this->next_trigger < this->entries.size() && !this->entries[this->next_trigger].trigger) ++this->next_trigger;
+		if (this->next_trigger == this->entries.size()) return;
+
+		entry_t& trigger = this->entries[this->next_trigger];
+		const double value = Quantity(population, trigger.quantity);
+		if (trigger.above ? value > trigger.threshold : value < trigger.threshold) {
+			trigger.fired_day = population.day;
+			++this->next_trigger;
+			TRACE(phase_t::setup, cout << "Schedule: " << quantity_names[trigger.quantity] << (trigger.above ? " > " : " < ")
+					   << trigger.threshold << " on day " << population.day << endl;);
+			this->Compile(this->settings);
+		}
+	}
+
+	// Days the triggers fired on (0 for the ones that didn't), kept with a checkpoint
+	vector<unsigned int> Fired() const{
+		vector<unsigned int> fired;
+		for (const entry_t& entry : this->entries) {
+			if (entry.trigger) fired.push_back(entry.fired_day);
+		}
+		return fired;
+	}
+	bool Restore(const vector<unsigned int>& fired){
+		size_t t = 0;
+		this->next_trigger = 0;
+		for (size_t e = 0; e < this->entries.size(); ++e) {
+			if (!this->entries[e].trigger) continue;
+			if (t == fired.size()) return false;
+			this->entries[e].fired_day = fired[t++];
+			if (this->entries[e].fired_day) this->next_trigger = e + 1;
+		}
+		this->Compile(this->settings);
+		return t == fired.size();
+	}
+
+private:
+	// Options a schedule can change
+	static constexpr const char* scheduled_options = "qijklmnpozUVWfg";
+	static constexpr unsigned int n_of_quantities = N_OF_SERIES + 2;
+	static constexpr const char* quantity_names[n_of_quantities] = {"Sick", "Dead", "Healthy", "Asymptomatic", "Mildly_symptomatic",
+																	"Severely_symptomatic", "ss_waiting_for_bed", "ss_in_bed"};
+
+	struct entry_t {
+		unsigned int first_day = 0, last_day = 0;
+		int opt = 0;
+		string value;
+		bool trigger = false, above = true;
+		unsigned int quantity = 0;
+		double threshold = 0;
+		// Day at the end of which the trigger fired
+		unsigned int fired_day = 0;
+	};
+
+	vector<entry_t> entries;
+	settings_t settings;
+	vector<day_parameters_t> days;
+	size_t next_trigger = 0;
+
+	static unsigned int ParseQuantity(const string& name){
+		for (unsigned int q = 0; q < n_of_quantities; ++q) {
+			if (name == quantity_names[q]) return q;
+		}
+		throw invalid_argument(name);
+	}
+
+	static double Quantity(const Population& population, unsigned int quantity){
+		if (quantity < N_OF_SERIES) return population.Series()[quantity];
+		return quantity == N_OF_SERIES ? population.ss_waiting_for_bed : population.ss_in_bed;
+	}
+
+	// The parameters with the option of the entry changed
+	day_parameters_t Changed(const day_parameters_t& parameters, const entry_t& entry) const{
+		settings_t changed = this->settings;
+		changed.probability_of = parameters.probability_of;
+		changed.average_daily_interactions = parameters.average_daily_interactions;
+		changed.hospital_capacity = parameters.hospital_capacity;
+		ApplyOption(changed, entry.opt, entry.value);
+		day_parameters_t result = parameters;
+		result.probability_of = changed.probability_of;
+		result.average_daily_interactions = changed.average_daily_interactions;
+		result.hospital_capacity = changed.hospital_capacity;
+		return result;
+	}
+
+	// Moves the values that differ between from and to the given part of the way
+	static void Ramp(day_parameters_t& day, const day_parameters_t& from, const day_parameters_t& to, double part){
+		auto ramp = [part](auto& value, double a, double b){
+			if (a != b) value = a + part * (b - a);
+		};
+		auto ramp_by_day = [part](vector<float>& values, const vector<float>& a, const vector<float>& b){
+			if (a.size() != b.size()) return;
+			for (size_t d = 0; d < values.size() && d < a.size(); ++d) {
+				if (a[d] != b[d]) values[d] = a[d] + part * (b[d] - a[d]);
+			}
+		};
+		probabilities_t& p = day.probability_of;
+		const probabilities_t &a = from.probability_of, &b = to.probability_of;
+		ramp(p.getting_sick, a.getting_sick, b.getting_sick);
+		ramp(p.healthy_staying_home, a.healthy_staying_home, b.healthy_staying_home);
+		ramp(p.mild_symptoms, a.mild_symptoms, b.mild_symptoms);
+		ramp(p.ms_staying_home, a.ms_staying_home, b.ms_staying_home);
+		ramp(p.hospital_recovery, a.hospital_recovery, b.hospital_recovery);
+		ramp(p.hospital_death, a.hospital_death, b.hospital_death);
+		ramp(p.home_recovery, a.home_recovery, b.home_recovery);
+		ramp(p.post_recovery_paranoia, a.post_recovery_paranoia, b.post_recovery_paranoia);
+		ramp_by_day(p.hospital_recovery_by_day, a.hospital_recovery_by_day, b.hospital_recovery_by_day);
+		ramp_by_day(p.hospital_death_by_day, a.hospital_death_by_day, b.hospital_death_by_day);
+		ramp_by_day(p.icu_step_up_by_day, a.icu_step_up_by_day, b.icu_step_up_by_day);
+		ramp_by_day(p.icu_recovery_by_day, a.icu_recovery_by_day, b.icu_recovery_by_day);
+		ramp_by_day(p.icu_death_by_day, a.icu_death_by_day, b.icu_death_by_day);
+		if (from.average_daily_interactions != to.average_daily_interactions) {
+			day.average_daily_interactions = (unsigned int)lround(from.average_daily_interactions
+				+ part * ((double)to.average_daily_interactions - from.average_daily_interactions));
+		}
+		if (from.hospital_capacity != to.hospital_capacity) {
+			day.hospital_capacity = (unsigned int)lround(from.hospital_capacity + part * ((double)to.hospital_capacity - from.hospital_capacity));
+		}
+	}
+};
+
+/* Runs one replicate with the engine selected in the settings, calling on_day(day, series) after every simulated day */
+template <class OnDay>
+void Simulate(const settings_t& settings, unsigned int replicate, const OnDay& on_day){
+	auto run = [&](auto population){
+		constexpr bool scheduled = is_same<decltype(population), Population>::value;
+		Schedule schedule;
+		if (settings.schedule) {
+			schedule = *settings.schedule;
+			schedule.Compile(settings);
+		}
+		while (population.day < settings.number_of_simulation_days) {
+			if constexpr (scheduled) schedule.Apply(population);
+			population.AdvanceDay();
+			if constexpr (scheduled) schedule.Observe(population);
+			on_day(population.day, population.Series());
+		}
+	};
+	switch (settings.engine) {
+		case engine_t::deterministic: run(NewMeanFieldPopulation(settings)); break;
+		case engine_t::agent: run(NewAgentPopulation(settings, replicate)); break;
+		case engine_t::ssa:
+		case engine_t::tau: run(NewReactionPopulation(settings, replicate)); break;
+		default: run(NewPopulation(settings, replicate));
+	}
+}
+
+/* Runs the single replicate of the settings day by day with the given model, every day goes to the output
+ * - A model restored from a checkpoint continues from its day, the days simulated before it are in the trajectory
+ * - Every checkpoint_every days the model and the trajectory so far are saved into the checkpoint file
+ * - The phases of the simulated days are measured into the metrics when given
+ * - A compiled schedule changes the parameters of the days it lists (compartment engines only)
+ * - Returns false when a checkpoint can't be saved */
+template <class Model>
+bool RunSingle(Model& population, TimeSeriesStore& trajectory, const settings_t& settings, OutputWriter& output, RunMetrics* metrics,
+			   Schedule& schedule){
+	day_record_t record;
+	for (unsigned int day = 0; day < trajectory.Days(); ++day) {
+		record.day = day + 1;
+		for (unsigned int s = 0; s < N_OF_SERIES; ++s) record.values[s] = trajectory.At(s, day);
+		output.Push(0, record);
+	}
+
+	// While tracing, the output of every day is collected and printed by the writer thread
+	stringstream day_log;
+	streambuf* terminal = cout.rdbuf();
+	if (Tracing::Any()) cout.rdbuf(day_log.rdbuf());
+
+	bool saved = true;
+	while (population.day < settings.number_of_simulation_days && saved) {
+		if constexpr (is_same<Model, Population>::value) schedule.Apply(population);
+		population.AdvanceDay(metrics);
+		if constexpr (is_same<Model, Population>::value) schedule.Observe(population);
+		if constexpr (is_same<Model, Population>::value) TRACE(phase_t::setup, Measured(metrics, METRIC_REPORT, population.counted, [&]{ population.Report(); }););
+		record.day = population.day;
+		record.values = population.Series();
+		trajectory.Append(record.values);
+		if (Tracing::Any()) {
+			record.log = day_log.str();
+			day_log.str("");
+		}
+		output.Push(0, record);
+
+		if (settings.checkpoint_every && population.day % settings.checkpoint_every == 0) {
+			CheckpointWriter checkpoint;
+			saved = checkpoint.Open(settings.checkpoint_file);
+			checkpoint.Value(settings.engine);
+			population.Checkpoint(checkpoint);
+			checkpoint.Value(trajectory);
+			checkpoint.Value(schedule.Fired());
+			saved = checkpoint.Close() && saved;
+		}
+	}
+	cout.rdbuf(terminal);
+	return saved;
+}
+
+/* Scenarios forked from one shared prefix of a simulation
+ * - The base population is simulated once up to the fork day and its days become the prefix every scenario shares
+ * - A scenario starts from a copy of the base population at the fork day (counters and short histograms only),
+ *   with its own chances and its own random streams (replicate = scenario number + 1)
+ * - Scenarios advance in parallel, each appending only its own days to a ForkedTimeSeries */
+class ScenarioFork {
+public:
+	vector<Population> scenarios;
+	vector<ForkedTimeSeries> histories;
+
+	ScenarioFork(Population base, unsigned int fork_day) : base(base){
+		TimeSeriesStore prefix(N_OF_SERIES, fork_day);
+		while (this->base.day < fork_day) {
+			this->base.AdvanceDay();
+			prefix.Append(this->base.Series());
+		}
+		this->prefix = make_shared<const TimeSeriesStore>(std::move(prefix));
+	}
+
+	// Adds a scenario continuing from the fork day with the given chances
+	void Fork(const probabilities_t& probabilities, unsigned int n_of_days){
+		this->scenarios.push_back(this->base);
+		this->scenarios.back().SetProbabilities(probabilities);
+		this->scenarios.back().replicate = this->base.replicate + this->scenarios.size();
+		// Scenarios already keep the threads busy
+		this->scenarios.back().interaction_threads = 1;
+		this->histories.emplace_back(this->prefix, n_of_days > this->base.day ? n_of_days - this->base.day : 0);
+	}
+
+	// Advances every scenario up to the last day
+	void Run(unsigned int last_day, unsigned int n_of_threads){
+		ParallelFor(this->scenarios.size(), n_of_threads, [&](unsigned int s, unsigned int){
+			while (this->scenarios[s].day < last_day) {
+				this->scenarios[s].AdvanceDay();
+				this->histories[s].Append(this->scenarios[s].Series());
+			}
+		});
+	}
+
+private:
+	Population base;
+	shared_ptr<const TimeSeriesStore> prefix;
+};
+
+/* Country made of regions connected by daily mobility
+ * - Every region is a Population with its own size, hospital capacity and incubation pipeline
+ * - The mobility share of an origin-destination pair is the part of the origin's people in public, healthy and
+ *   infectious, who mix into the destination's interaction circles each day (commuters)
+ * - Travelling healthy people are moved into the destination for its interactions, whatever happens to them there
+ *   (infection, going home scared or nothing) goes back to their origin; infectious travellers only count in the
+ *   circles of the destination, their illness keeps progressing at home
+ * - A day has two synchronization points, drawing the travellers and returning them after the interactions,
+ *   the regions advance in parallel in between and after */
+class Metapopulation {
+public:
+	vector<string> names;
+	vector<Population> regions;
+	unsigned int number_of_threads = 0;
+
+	// Sparse origin-destination matrix in compressed rows: the edges of origin i are [first_edge[i], first_edge[i+1])
+	vector<unsigned int> first_edge;
+	vector<unsigned int> destination;
+	vector<double> share;
+
+	unsigned int day = 0;
+
+	/* Builds the compressed rows from (origin, destination, share) triplets */
+	void SetMobility(vector<tuple<unsigned int, unsigned int, double>> edges){
+		sort(edges.begin(), edges.end());
+		this->first_edge.assign(this->regions.size() + 1, 0);
+		this->destination.clear();
+		this->share.clear();
+		for (const auto& edge : edges) {
+			++this->first_edge[get<0>(edge) + 1];
+			this->destination.push_back(get<1>(edge));
+			this->share.push_back(get<2>(edge));
+		}
+		for (unsigned int i = 0; i < this->regions.size(); ++i) {
+			this->first_edge[i + 1] += this->first_edge[i];
+		}
+		this->travelling_infectious.assign(this->destination.size(), 0);
+		this->travelling_mildly_infectious.assign(this->destination.size(), 0);
+		this->travelling_healthy.assign(this->destination.size(), 0);
+	}
+
+	void AdvanceDay(){
+		++this->day;
+		if (this->first_edge.size() != this->regions.size() + 1) this->SetMobility({});
+
+		WorkerPool& workers = this->workers.Get(min<size_t>(ThreadCount(this->number_of_threads), this->regions.size()));
+
+		// Draw the travellers of every origin as a multinomial split over its destinations
+		workers.Run(this->regions.size(), [&](unsigned int i, unsigned int){
+			Population& origin = this->regions[i];
+			RandomStream rng(origin.seed, origin.replicate, this->day, phase_t::mobility, i);
+			unsigned int infectious = origin.IncubatingInfectious();
+			unsigned int mildly_infectious = origin.ms_in_public;
+			unsigned int healthy = origin.healthy_in_public;
+			double share_left = 1.0;
+			origin.away_infectious = origin.away_mildly_infectious = 0;
+
+			for (unsigned int e = this->first_edge[i]; e < this->first_edge[i + 1]; ++e) {
+				double p = (share_left > 0.0) ? min(this->share[e] / share_left, 1.0) : 0.0;
+				this->travelling_infectious[e] = Binomial(rng, infectious, p);
+				this->travelling_mildly_infectious[e] = Binomial(rng, mildly_infectious, p);
+				this->travelling_healthy[e] = Binomial(rng, healthy, p);
+				infectious -= this->travelling_infectious[e];
+				mildly_infectious -= this->travelling_mildly_infectious[e];
+				healthy -= this->travelling_healthy[e];
+				origin.away_infectious += this->travelling_infectious[e];
+				origin.away_mildly_infectious += this->travelling_mildly_infectious[e];
+				share_left -= this->share[e];
+			}
+		});
+
+		for (auto& region : this->regions) {
+			region.visiting_infectious = region.visiting_mildly_infectious = 0;
+		}
+		for (unsigned int i = 0; i < this->regions.size(); ++i) {
+			for (unsigned int e = this->first_edge[i]; e < this->first_edge[i + 1]; ++e) {
+				Population& destination = this->regions[this->destination[e]];
+				destination.visiting_infectious += this->travelling_infectious[e];
+				destination.visiting_mildly_infectious += this->travelling_mildly_infectious[e];
+				this->regions[i].healthy_in_public -= this->travelling_healthy[e];
+				destination.healthy_in_public += this->travelling_healthy[e];
+			}
+		}
+
+		// The phases of Population::AdvanceDay, split by the return of the travellers after the interactions
+		this->mixed.resize(this->regions.size());
+		workers.Run(this->regions.size(), [&](unsigned int i, unsigned int){
+			Population& region = this->regions[i];
+			mixed_t& mixed = this->mixed[i];
+			mixed.healthy = region.healthy_in_public;
+			mixed.infected_at_home = region.asymptomatic_at_home;
+			mixed.infected_in_public = region.asymptomatic_in_public;
+			mixed.gone_home = region.healthy_at_home;
+			++region.day;
+			region.CalculateInteractions();
+			mixed.infected_at_home = region.asymptomatic_at_home - mixed.infected_at_home;
+			mixed.infected_in_public = region.asymptomatic_in_public - mixed.infected_in_public;
+			mixed.gone_home = region.healthy_at_home - mixed.gone_home;
+		});
+		this->ReturnTravellers();
+		workers.Run(this->regions.size(), [&](unsigned int i, unsigned int){
+			this->regions[i].HomeQuarantine();
+			this->regions[i].IllnessAdvances();
+			this->regions[i].Hospital();
+		});
+	}
+
+	// Values of the data.dat columns summed over all regions
+	series_values_t Series() const{
+		series_values_t total = {};
+		for (const auto& region : this->regions) {
+			series_values_t values = region.Series();
+			for (unsigned int s = 0; s < N_OF_SERIES; ++s) total[s] += values[s];
+		}
+		return total;
+	}
+
+private:
+	// Threads advancing the regions, kept for the whole run
+	LazyWorkerPool workers;
+	// Travellers drawn for each edge on the current day
+	vector<unsigned int> travelling_infectious, travelling_mildly_infectious, travelling_healthy;
+
+	// Healthy people in the circles of a region today and how many of them got infected or went home
+	struct mixed_t {
+		unsigned int healthy, infected_at_home, infected_in_public, gone_home;
+	};
+	vector<mixed_t> mixed;
+
+	/* Sends the healthy travellers back to their origins with what happened to them
+	 * - Visitors and residents of a destination met in the same circles, so the travellers of an edge are a sample
+	 *   drawn without replacement from everyone healthy there (multivariate hypergeometric over the outcomes) */
+	void ReturnTravellers(){
+		if (this->regions.empty()) return;
+		RandomStream rng(this->regions[0].seed, this->regions[0].replicate, this->day, phase_t::mobility, this->regions.size());
+		for (unsigned int i = 0; i < this->regions.size(); ++i) {
+			Population& origin = this->regions[i];
+			for (unsigned int e = this->first_edge[i]; e < this->first_edge[i + 1]; ++e) {
+				Population& destination = this->regions[this->destination[e]];
+				mixed_t& mixed = this->mixed[this->destination[e]];
+				unsigned int travellers = this->travelling_healthy[e];
+
+				// Each outcome in turn, drawn from the people of the outcomes not drawn yet
+				unsigned int* outcomes[] = {&mixed.infected_at_home, &mixed.infected_in_public, &mixed.gone_home};
+				unsigned int taken[3], left = mixed.healthy;
+				mixed.healthy -= travellers;
+				for (unsigned int o = 0; o < 3; ++o) {
+					taken[o] = Hypergeometric(rng, *outcomes[o], left - *outcomes[o], travellers);
+					left -= *outcomes[o];
+					*outcomes[o] -= taken[o];
+					travellers -= taken[o];
+				}
+				// The rest of the travellers stayed healthy in public
+
+				destination.asymptomatic_at_home -= taken[0];
+				origin.asymptomatic_at_home += taken[0];
+				destination.asymptomatic_in_public -= taken[1];
+				destination.incubating[0] -= taken[1];
+				origin.asymptomatic_in_public += taken[1];
+				origin.incubating[0] += taken[1];
+				destination.healthy_at_home -= taken[2];
+				origin.healthy_at_home += taken[2];
+				destination.healthy_in_public -= travellers;
+				origin.healthy_in_public += travellers;
+			}
+		}
+	}
+};
+
+/* Reads the regions from lines "name population initSick hospCap", all other settings are shared
+ * - Empty lines and lines starting with # are skipped */
+bool LoadRegions(const string& filename, const settings_t& settings, unsigned int replicate, Metapopulation& country){
+	ifstream file(filename);
+	if (!file.is_open()) return false;
+
+	string line;
+	while (getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		istringstream fields(line);
+		string name;
+		settings_t region = settings;
+		if (!(fields >> name >> region.total_population >> region.initial_number_of_sick >> region.hospital_capacity)) return false;
+		// The interaction pools key their random streams by the region
+		if (country.regions.size() == max_regions) return false;
+
+		country.names.push_back(name);
+		country.regions.push_back(NewPopulation(region, replicate));
+		country.regions.back().region = country.regions.size() - 1;
+		// Regions already keep the threads busy
+		country.regions.back().interaction_threads = 1;
+	}
+	return !country.regions.empty();
+}
+
+/* Reads the mobility from lines "origin destination share", share being in % of the origin's people in public
+ * - Regions are referred to by their names from the regions file */
+bool LoadMobility(const string& filename, Metapopulation& country){
+	ifstream file(filename);
+	if (!file.is_open()) return false;
+
+	vector<tuple<unsigned int, unsigned int, double>> edges;
+	string line;
+	while (getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		istringstream fields(line);
+		string origin, destination;
+		double share;
+		if (!(fields >> origin >> destination >> share) || share < 0.0) return false;
+
+		auto origin_it = find(country.names.begin(), country.names.end(), origin);
+		auto destination_it = find(country.names.begin(), country.names.end(), destination);
+		if (origin_it == country.names.end() || destination_it == country.names.end()) return false;
+		edges.emplace_back(origin_it - country.names.begin(), destination_it - country.names.begin(), share / 100);
+	}
+	country.SetMobility(edges);
+	return true;
+}
+
+/* One swept option: its getopt code, name and the list of values it takes */
+struct sweep_dimension_t {
+	int opt = 0;
+	string name;
+	vector<string> values;
+};
+
+/* Parses NAME=VALUES where VALUES is a comma separated list of values and from:to[:step] ranges
+ * - NAME is the name of any option that holds a setting (e.g. CgetSick=5:25:5,50)
+ * - Returns false when the name is unknown or a value is invalid for the option */
+bool ParseSweep(const string& spec, sweep_dimension_t& dimension){
+	size_t equals = spec.find('=');
+	if (equals == string::npos) return false;
+	dimension.name = spec.substr(0, equals);
+	dimension.opt = 0;
+	for (const option* o = long_opts; o->name; ++o) {
+		if (dimension.name == o->name) dimension.opt = o->val;
+	}
+
+	settings_t scratch;
+	string list = spec.substr(equals + 1);
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t comma = list.find(',', start);
+		if (comma == string::npos) comma = list.size();
+		string item = list.substr(start, comma - start);
+		start = comma + 1;
+
+		size_t colon = item.find(':');
+		if (colon == string::npos) {
+			dimension.values.push_back(item);
+		}
+		else {
+			try {
+				size_t second_colon = item.find(':', colon + 1);
+				long long from = stoll(item.substr(0, colon));
+				long long to = stoll(item.substr(colon + 1, second_colon - colon - 1));
+				long long step = (second_colon == string::npos) ? 1 : stoll(item.substr(second_colon + 1));
+				if (step <= 0) return false;
+				for (long long value = from; value <= to; value += step) {
+					dimension.values.push_back(to_string(value));
+				}
+			}
+			catch (const logic_error&) { return false; }
+		}
+	}
+
+	for (const string& value : dimension.values) {
+		if (!ApplyOption(scratch, dimension.opt, value)) return false;
+	}
+	return !dimension.values.empty();
+}
+
+/* Parses NAME=VALUE[;NAME=VALUE...] overriding the chances of the base settings for one forked scenario
+ * - Only the chance options (CgetSick, ..., ChospitalDeathByDay) can differ between scenarios
+ * - Returns false when a name is unknown, not a chance or its value is invalid */
+bool ParseScenario(const string& spec, const settings_t& base, probabilities_t& probabilities){
+	settings_t scenario = base;
+	stringstream assignments(spec);
+	string assignment;
+	while (getline(assignments, assignment, ';')) {
+		size_t equals = assignment.find('=');
+		if (equals == string::npos) return false;
+		const string name = assignment.substr(0, equals);
+		int opt = 0;
+		for (const option* o = long_opts; o->name; ++o) {
+			if (name == o->name) opt = o->val;
+		}
+		if (opt == 0 || !strchr("qijklmnpoz", opt)) return false;
+		if (!ApplyOption(scenario, opt, assignment.substr(equals + 1))) return false;
+	}
+	probabilities = scenario.probability_of;
+	return true;
+}
+
+/* Final state and peak load of one point of a parameter sweep */
+struct sweep_result_t {
+	series_values_t final_values;
+	double peak_severely_symptomatic = 0.0;
+	unsigned int peak_day = 0;
+};
+
+/* Runs every combination of the swept values (and every replicate of each) on the thread pool
+ * - Points are decoded from their index, so no list of all combinations is ever built
+ * - Results are written in the order of the points into one table keyed by the swept values */
+bool RunSweep(const settings_t& base, const vector<sweep_dimension_t>& dimensions, const string& filename){
+	unsigned int n_of_points = 1;
+	for (const auto& dimension : dimensions) n_of_points *= dimension.values.size();
+	const unsigned int n_of_replicates = max(base.number_of_replicates, 1u);
+
+	vector<sweep_result_t> results((size_t)n_of_points * n_of_replicates);
+	ParallelFor(results.size(), base.number_of_threads, [&](unsigned int task, unsigned int){
+		settings_t settings = base;
+		unsigned int point = task / n_of_replicates;
+		for (const auto& dimension : dimensions) {
+			ApplyOption(settings, dimension.opt, dimension.values[point % dimension.values.size()]);
+			point /= dimension.values.size();
+		}
+		// Points already keep the threads busy
+		settings.number_of_threads = 1;
+
+		sweep_result_t& result = results[task];
+		Simulate(settings, task % n_of_replicates, [&](unsigned int day, const series_values_t& values){
+			if (values[SEVERELY_SYMPTOMATIC] > result.peak_severely_symptomatic) {
+				result.peak_severely_symptomatic = values[SEVERELY_SYMPTOMATIC];
+				result.peak_day = day;
+			}
+			result.final_values = values;
+		});
+	});
+
+	ofstream file(filename);
+	if (!file.is_open()) return false;
+	file << "#";
+	for (const auto& dimension : dimensions) file << " " << dimension.name;
+	file << " Replicate";
+	for (unsigned int s = 0; s < N_OF_SERIES; ++s) file << " " << series_names[s];
+	file << " Peak_severely_symptomatic Peak_day\n";
+	// Whole numbers unless a point kept fractions (the mean-field engine), as in data.dat
+	int precision = 0;
+	for (const auto& result : results) {
+		for (double value : result.final_values) {
+			if (value != floor(value)) precision = 2;
+		}
+	}
+	file << fixed << setprecision(precision);
+
+	for (size_t task = 0; task < results.size(); ++task) {
+		unsigned int point = task / n_of_replicates;
+		for (const auto& dimension : dimensions) {
+			file << dimension.values[point % dimension.values.size()] << " ";
+			point /= dimension.values.size();
+		}
+		file << task % n_of_replicates;
+		for (double value : results[task].final_values) file << " " << value;
+		file << " " << results[task].peak_severely_symptomatic << " " << results[task].peak_day << "\n";
+	}
+	return true;
+}
+
+/* Compares the closed form of the interactions with forming the circles
+ * - On every day of a run of the settings, the interactions of the next day are drawn trials times each way
+ *   from the same state, every trial with random numbers of its own
+ * - The file gets per day the mean and standard deviation of the infections and precautionary stays at home
+ *   of both ways and the time they took, the differences over the whole run are printed */
+bool CompareClosedForm(const settings_t& settings, const string& filename){
+	ofstream file(filename);
+	if (!file.is_open()) return false;
+	file << "# Day Infectious Healthy Circles_infected Circles_infected_sd Closed_infected Closed_infected_sd"
+		 << " Circles_scared Closed_scared Circles_ns Closed_ns\n" << fixed << setprecision(2);
+
+	Population population = NewPopulation(settings, 0);
+	population.closed_form_interactions = false;
+	const double trials = settings.closed_form_trials;
+	double total_ns[2] = {}, relative_difference = 0, largest_difference = 0, squared_z = 0;
+	unsigned int compared = 0, largest_day = 0;
+	while (population.day < settings.number_of_simulation_days) {
+		// Sums of the infected, their squares, the scared and the ns, for the circles and the closed form
+		double sums[2][4] = {};
+		for (unsigned int trial = 0; trial < settings.closed_form_trials; ++trial) {
+			for (unsigned int closed = 0; closed < 2; ++closed) {
+				Population drawn = population;
+				++drawn.day;
+				drawn.replicate = trial + 1;
+				drawn.closed_form_interactions = closed;
+				const RunMetrics::clock::time_point start = RunMetrics::clock::now();
+				drawn.CalculateInteractions();
+				sums[closed][3] += RunMetrics::Elapsed(start);
+				const double scared = (double)drawn.healthy_at_home - population.healthy_at_home;
+				const double infected = (double)population.healthy_in_public - drawn.healthy_in_public - scared;
+				sums[closed][0] += infected;
+				sums[closed][1] += infected * infected;
+				sums[closed][2] += scared;
+			}
+		}
+
+		double mean[2], variance[2];
+		for (unsigned int closed = 0; closed < 2; ++closed) {
+			mean[closed] = sums[closed][0] / trials;
+			variance[closed] = max(sums[closed][1] / trials - mean[closed] * mean[closed], 0.0);
+			total_ns[closed] += sums[closed][3];
+		}
+		file << population.day + 1 << " " << population.IncubatingInfectious() + population.ms_in_public << " " << population.healthy_in_public
+			 << " " << mean[0] << " " << sqrt(variance[0]) << " " << mean[1] << " " << sqrt(variance[1])
+			 << " " << sums[0][2] / trials << " " << sums[1][2] / trials
+			 << " " << sums[0][3] / trials << " " << sums[1][3] / trials << "\n";
+
+		if (mean[0] >= 1.0) {
+			const double difference = fabs(mean[1] - mean[0]) / mean[0];
+			relative_difference += difference;
+			if (difference > largest_difference) {
+				largest_difference = difference;
+				largest_day = population.day + 1;
+			}
+			if (variance[0] + variance[1] > 0.0) {
+				squared_z += (mean[1] - mean[0]) * (mean[1] - mean[0]) / ((variance[0] + variance[1]) / trials);
+			}
+			++compared;
+		}
+		population.AdvanceDay();
+	}
+
+	cout << "Closed form against circles over " << compared << " days with infections (" << settings.closed_form_trials << " draws a day):" << endl
+		 << fixed << setprecision(2)
+		 << " - mean infections differ by " << 100 * (compared ? relative_difference / compared : 0.0) << "% on average, at most by "
+		 << 100 * largest_difference << "% (day " << largest_day << ")" << endl
+		 << " - root mean square z-score of the differences: " << sqrt(compared ? squared_z / compared : 0.0)
+		 << " (about 1 when they are within the noise)" << endl
+		 << " - interactions took " << total_ns[0] / 1e6 << " ms with circles and " << total_ns[1] / 1e6 << " ms in closed form" << endl;
+	return true;
+}
+
+// The benchmarks (bench.cpp) include the model without the program
+#ifndef IMS_NO_MAIN
+int main(int argc, char* argv[]) {
+	settings_t settings;
+	vector<sweep_dimension_t> sweep;
+	vector<string> scenario_specs;
+	// Options given on the command line, a resumed checkpoint must not contradict them
+	string given_options;
+
+	while (true)
+	{
+		const auto opt = getopt_long_only(argc, argv, "", long_opts, nullptr);
+
+		if (opt == -1)
+			break;
+
+		switch (opt)
+		{
+			case 'v':
+				sweep.emplace_back();
+				if (!ParseSweep(optarg, sweep.back())) {
+					cout << "Invalid sweep: " << optarg << endl;
+					return 1;
+				}
+				break;
+			case 'S':
+				scenario_specs.push_back(optarg);
+				break;
+			case 'T': {
+				auto schedule = make_shared<Schedule>();
+				string error;
+				if (!schedule->Load(optarg, error)) {
+					cout << "Invalid schedule: " << error << endl;
+					return 1;
+				}
+				settings.schedule = schedule;
+				break;
+			}
+			case 'h': // -h or --help
+			case '?': // Unrecognized option
+				PrintHelp();
+				return 0;
+			default:
+				if (!ApplyOption(settings, opt, optarg ? optarg : "")) {
+					PrintHelp();
+					return 0;
+				}
+				given_options += (char)opt;
+		}	
+	}
+
+	// Text form of an events file
+	if (!settings.events_dump_file.empty()) {
+		if (!RenderEvents(settings.events_dump_file, cout)) {
+			cout << "Invalid events file: " << settings.events_dump_file << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// Events of the simulation kept in memory and dumped however the program ends
+	if (!settings.events_file.empty()) {
+		if (!DefaultTrace::RecordsAny()) {
+			cout << "This build records no events, rebuild it with IMS_EVENTS set (e.g. make main-events)" << endl;
+			return 1;
+		}
+		EventLog::Enable(settings.event_ring, settings.event_sample);
+		EventLog::DumpAtExit(settings.events_file);
+	}
+
+	// Trace lines are written into cout as they happen, so a tracing build simulates on one thread, where the
+	// ensembles, sweeps, regions and scenarios print them in order and single runs hand them to the output thread
+	if (Tracing::Any()) settings.number_of_threads = 1;
+
+	// Regions couple populations of the compartment engines in a single run, which isn't saved into checkpoints
+	if (!settings.regions_file.empty() && ((settings.engine != engine_t::individual && settings.engine != engine_t::aggregate)
+										   || !settings.resume_file.empty() || settings.number_of_replicates > 1)) {
+		cout << "Regions can only be simulated with the individual or aggregate engine, in a single run that can't be resumed" << endl;
+		return 1;
+	}
+
+	// Intensive care is a tier of the hospitals of the compartment engines
+	if (settings.engine != engine_t::individual && settings.engine != engine_t::aggregate) {
+		bool intensive_care = given_options.find_first_of("HUVW") != string::npos;
+		for (const sweep_dimension_t& dimension : sweep) intensive_care |= dimension.opt && strchr("HUVW", dimension.opt);
+		if (intensive_care) {
+			cout << "Intensive care can only be simulated with the individual or aggregate engine" << endl;
+			return 1;
+		}
+	}
+
+	// Schedules change the compartments of a single population
+	if (settings.schedule && ((settings.engine != engine_t::individual && settings.engine != engine_t::aggregate)
+							  || !settings.regions_file.empty() || !scenario_specs.empty())) {
+		cout << "Schedules can only be followed by the individual or aggregate engine without regions or scenarios" << endl;
+		return 1;
+	}
+
+	// Ensembles, sweeps, regions, scenarios and the comparison of the closed form run more than one single run
+	const bool single_run = sweep.empty() && scenario_specs.empty() && settings.regions_file.empty() && !settings.closed_form_trials
+							&& (settings.number_of_replicates <= 1 || !settings.resume_file.empty()
+								|| settings.engine == engine_t::deterministic);
+	if (!single_run && settings.checkpoint_every) {
+		cout << "Checkpoints can only be saved by a single run" << endl;
+		return 1;
+	}
+	if (!single_run && !settings.metrics_file.empty()) {
+		cout << "Metrics can only be measured in a single run" << endl;
+		return 1;
+	}
+	if (!single_run && settings.perf_counters) {
+		cout << "Hardware counters can only be read in a single run" << endl;
+		return 1;
+	}
+
+	// Parameter sweep: every combination of the swept values in one consolidated table
+	if (!sweep.empty()) {
+		if (RunSweep(settings, sweep, "sweep.dat"))
+			cout << "Results of the sweep written to sweep.dat" << endl;
+		else cout << "Unable to open file";
+		return 0;
+	}
+
+	// Conversion of a binary file back into data.dat
+	if (!settings.export_file.empty()) {
+		SeriesFileReader series;
+		if (!series.Open(settings.export_file) || series.Metrics() != N_OF_SERIES) {
+			cout << "Invalid binary file: " << settings.export_file << endl;
+			return 1;
+		}
+		if (WriteTrajectory(series, "data.dat", -1))
+			cout << "Trajectory exported to data.dat" << endl;
+		else cout << "Unable to open file";
+		return 0;
+	}
+
+	// Scenarios sharing the days up to the fork day, each written with its number into scenarios.dat
+	if (!scenario_specs.empty()) {
+		if (settings.engine != engine_t::individual && settings.engine != engine_t::aggregate) {
+			cout << "Scenarios can only be forked with the individual or aggregate engine" << endl;
+			return 1;
+		}
+		const unsigned int fork_day = min(settings.fork_day, settings.number_of_simulation_days);
+		ScenarioFork fork(NewPopulation(settings, 0), fork_day);
+		for (const string& spec : scenario_specs) {
+			probabilities_t probabilities;
+			if (!ParseScenario(spec, settings, probabilities)) {
+				cout << "Invalid scenario: " << spec << endl;
+				return 1;
+			}
+			fork.Fork(probabilities, settings.number_of_simulation_days);
+		}
+		fork.Run(settings.number_of_simulation_days, settings.number_of_threads);
+
+		ofstream scenarios_file ("scenarios.dat");
+		if (!scenarios_file.is_open()) {
+			cout << "Unable to open file";
+			return 1;
+		}
+		// Scenarios fork the individual or aggregate engine, which count whole people as in data.dat
+		scenarios_file << "# Day Scenario Sick Dead Healthy Asymptomatic Mildly_symptomatic Severely_symptomatic\n"
+					   << fixed << setprecision(0);
+		for (unsigned int s = 0; s < fork.histories.size(); ++s) {
+			const ForkedTimeSeries& history = fork.histories[s];
+			for (unsigned int day = 0; day < history.Days(); ++day) {
+				scenarios_file << day + 1 << " " << s + 1;
+				for (unsigned int series = 0; series < N_OF_SERIES; ++series) scenarios_file << " " << history.At(series, day);
+				scenarios_file << "\n";
+			}
+			cout << "Scenario " << s + 1 << ": " << scenario_specs[s] << endl;
+		}
+		cout << "Simulated " << fork.histories.size() << " scenarios forked on day " << fork_day << " into scenarios.dat" << endl;
+		return 0;
+	}
+
+	// Accuracy of the closed form of the interactions, written into closedform.dat
+	if (settings.closed_form_trials) {
+		if (settings.engine != engine_t::individual && settings.engine != engine_t::aggregate) {
+			cout << "The closed form can only be compared with the individual or aggregate engine" << endl;
+			return 1;
+		}
+		if (CompareClosedForm(settings, "closedform.dat"))
+			cout << "Comparison written to closedform.dat" << endl;
+		else cout << "Unable to open file";
+		return 0;
+	}
+
+	// A resumed run takes the engine and the whole population from the checkpoint
+	CheckpointReader resumed;
+	if (!settings.resume_file.empty()) {
+		if (!resumed.Open(settings.resume_file)) {
+			cout << "Invalid checkpoint: " << settings.resume_file << endl;
+			return 1;
+		}
+		resumed.Value(settings.engine);
+	}
+
+	// Single run, its days are written by a separate thread and the binary file replaces data.dat
+	TimeSeriesStore trajectory(N_OF_SERIES, settings.number_of_simulation_days);
+	auto run_single = [&](auto population){
+		Schedule schedule;
+		if (settings.schedule) {
+			schedule = *settings.schedule;
+			schedule.Compile(settings);
+		}
+		if (!settings.resume_file.empty()) {
+			population.Checkpoint(resumed);
+			resumed.Value(trajectory);
+			vector<unsigned int> fired;
+			resumed.Value(fired);
+			if (!resumed.Good() || trajectory.Days() != population.day || !schedule.Restore(fired)) {
+				cout << "Invalid checkpoint: " << settings.resume_file << endl;
+				return 1;
+			}
+			// The interactions go on as they were formed before the checkpoint
+			if constexpr (is_same<decltype(population), Population>::value) {
+				if ((given_options.find('I') != string::npos && population.interaction_pools != settings.interaction_pools)
+					|| (given_options.find('A') != string::npos && !population.closed_form_interactions)) {
+					cout << "The checkpoint forms the interactions differently than -interactionPools or -closedForm ask" << endl;
+					return 1;
+				}
+			}
+		}
+
+		OutputWriter output(1, settings.number_of_simulation_days);
+		output.binary_file = settings.binary_file;
+		output.jsonl_file = settings.jsonl_file;
+		output.text_file = settings.binary_file.empty() ? "data.dat" : "";
+		output.precision = settings.engine == engine_t::deterministic ? 2 : 0;
+		RunMetrics metrics;
+		RunMetrics* measured = settings.metrics_file.empty() && !settings.perf_counters ? nullptr : &metrics;
+		// Without counters the run goes on with the other metrics
+		if (settings.perf_counters) metrics.OpenPerfCounters();
+		output.metrics = measured;
+		if (!output.Start(1, max(settings.number_of_simulation_days, population.day))) {
+			cout << "Unable to open file";
+			return 1;
+		}
+		const bool saved = RunSingle(population, trajectory, settings, output, measured, schedule);
+		output.Finish();
+		if (!saved) {
+			cout << "Unable to save checkpoint: " << settings.checkpoint_file << endl;
+			return 1;
+		}
+
+		if constexpr (is_same<decltype(population), Population>::value) {
+			Measured(measured, METRIC_REPORT, population.counted, [&]{ population.Report(); });
+		}
+		else cout << "Trajectory written to " << (settings.binary_file.empty() ? "data.dat" : settings.binary_file) << endl;
+
+		if (settings.perf_counters) metrics.WritePerfSummary(cout);
+		if (!settings.metrics_file.empty() && !metrics.Write(settings.metrics_file, engine_names[(int)settings.engine])) {
+			cout << "Unable to open file";
+			return 1;
+		}
+		return 0;
+	};
+
+	// Expected trajectory of the mean-field engine, a single run of the agent based or the continuous time engines
+	// (their ensembles run below)
+	const bool single = settings.number_of_replicates <= 1 || !settings.resume_file.empty();
+	if (settings.engine == engine_t::deterministic) return run_single(NewMeanFieldPopulation(settings));
+	if (settings.engine == engine_t::agent && single) return run_single(NewAgentPopulation(settings, 0));
+	if ((settings.engine == engine_t::ssa || settings.engine == engine_t::tau) && single) {
+		return run_single(NewReactionPopulation(settings, 0));
+	}
+
+	// Metapopulation: coupled regions, per region results in regions.dat and their sum in data.dat
+	if (!settings.regions_file.empty()) {
+		Metapopulation country;
+		country.number_of_threads = settings.number_of_threads;
+		if (!LoadRegions(settings.regions_file, settings, 0, country)) {
+			cout << "Invalid regions file: " << settings.regions_file << endl;
+			return 1;
+		}
+		if (!settings.mobility_file.empty() && !LoadMobility(settings.mobility_file, country)) {
+			cout << "Invalid mobility file: " << settings.mobility_file << endl;
+			return 1;
+		}
+
+		// The regions and their sum go to the writer thread day by day
+		OutputWriter output(1, 4096);
+		output.binary_file = settings.binary_file;
+		output.jsonl_file = settings.jsonl_file;
+		output.text_file = settings.binary_file.empty() ? "data.dat" : "";
+		output.regions_file = "regions.dat";
+		output.region_names = country.names;
+		if (!output.Start(1, settings.number_of_simulation_days)) {
+			cout << "Unable to open file";
+			return 1;
+		}
+		day_record_t record;
+		while (country.day < settings.number_of_simulation_days) {
+			country.AdvanceDay();
+			record.day = country.day;
+			for (unsigned int r = 0; r < country.regions.size(); ++r) {
+				record.region = r;
+				record.values = country.regions[r].Series();
+				output.Push(0, record);
+			}
+			record.region = -1;
+			record.values = country.Series();
+			output.Push(0, record);
+		}
+		output.Finish();
+		cout << "Simulated " << country.regions.size() << " regions into regions.dat and "
+			 << (settings.binary_file.empty() ? "data.dat" : settings.binary_file) << endl;
+		return 0;
+	}
+
+	// Monte Carlo ensemble: independent replicates on a thread pool summarized into one file
+	if (settings.number_of_replicates > 1 && settings.resume_file.empty()) {
+		const unsigned int n_of_threads = ThreadCount(settings.number_of_threads);
+		OutputWriter output(n_of_threads, 4096);
+		output.binary_file = settings.binary_file;
+		output.jsonl_file = settings.jsonl_file;
+		const bool streamed = !output.binary_file.empty() || !output.jsonl_file.empty();
+		if (streamed && !output.Start(settings.number_of_replicates, settings.number_of_simulation_days)) {
+			cout << "Unable to open file";
+			return 1;
+		}
+
+		Ensemble ensemble(settings.number_of_replicates, settings.number_of_simulation_days);
+		// One store per worker, reused by all the replicates it runs
+		vector<TimeSeriesStore> trajectories(n_of_threads, TimeSeriesStore(N_OF_SERIES, settings.number_of_simulation_days));
+		ParallelFor(settings.number_of_replicates, settings.number_of_threads, [&](unsigned int replicate, unsigned int worker){
+			TimeSeriesStore& replicate_trajectory = trajectories[worker];
+			replicate_trajectory.Clear();
+			day_record_t record;
+			record.replicate = replicate;
+			Simulate(settings, replicate, [&](unsigned int day, const series_values_t& values){
+				replicate_trajectory.Append(values);
+				record.day = day;
+				record.values = values;
+				output.Push(worker, record);
+			});
+			ensemble.Add(replicate, replicate_trajectory);
+		});
+		output.Finish();
+
+		if (ensemble.Write("ensemble.dat"))
+			cout << "Summary of " << settings.number_of_replicates << " replicates written to ensemble.dat" << endl;
+		else cout << "Unable to open file";
+		return 0;
+	}
+
+	return run_single(NewPopulation(settings, 0));
 }
+#endif //IMS_NO_MAIN
@@ -0,0 +1,211 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_METRICS_H
+#define IMS_METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+
+/* Where the time of a run goes
+ * - Models count their random draws and events into a phase_counters_t as they go, a few additions per phase
+ * - AdvanceDay runs every phase through Measured(), which without a RunMetrics is just the call, with one it
+ *   also times the phase and attributes the counters that changed meanwhile to it
+ * - The report and the output of every day are timed as well, the output on the writer thread into its own slots
+ * - With OpenPerfCounters() the phases also count hardware events of the simulating thread
+ * - RunMetrics::Write() summarises everything per day and in total as JSON */
+
+enum metric_phase_t { METRIC_INTERACTIONS, METRIC_HOME_QUARANTINE, METRIC_ILLNESS, METRIC_HOSPITAL, METRIC_REPORT, METRIC_OUTPUT,
+					  N_OF_METRIC_PHASES };
+const char* const metric_phase_names[N_OF_METRIC_PHASES] = {"interactions", "home_quarantine", "illness", "hospital", "report", "output"};
+
+// Running totals of a model (expected values in the deterministic engine, which draws no numbers)
+struct phase_counters_t {
+	double draws = 0, groups = 0, infections = 0, admissions = 0, deaths = 0;
+
+	phase_counters_t& operator+=(const phase_counters_t& other){
+		this->draws += other.draws;
+		this->groups += other.groups;
+		this->infections += other.infections;
+		this->admissions += other.admissions;
+		this->deaths += other.deaths;
+		return *this;
+	}
+	phase_counters_t operator-(const phase_counters_t& other) const{
+		phase_counters_t difference = *this;
+		difference.draws -= other.draws;
+		difference.groups -= other.groups;
+		difference.infections -= other.infections;
+		difference.admissions -= other.admissions;
+		difference.deaths -= other.deaths;
+		return difference;
+	}
+};
+
+struct phase_metrics_t {
+	uint64_t calls = 0;
+	double ns = 0;
+	phase_counters_t counted;
+	perf_values_t perf;
+
+	phase_metrics_t& operator+=(const phase_metrics_t& other){
+		this->calls += other.calls;
+		this->ns += other.ns;
+		this->counted += other.counted;
+		this->perf += other.perf;
+		return *this;
+	}
+};
+
+struct day_metrics_t {
+	unsigned int day = 0;
+	phase_metrics_t phases[N_OF_METRIC_PHASES];
+};
+
+/* Metrics of one run collected day by day */
+class RunMetrics {
+public:
+	typedef std::chrono::steady_clock clock;
+
+	/* Counts hardware events of the calling thread, which has to be the one measuring the phases
+	 * - Returns false when no counter is available, the metrics then go on without them */
+	bool OpenPerfCounters(){
+		return this->perf.Open();
+	}
+
+	// Following measurements belong to the given day
+	void StartDay(unsigned int day){
+		if (this->days.empty() || this->days.back().day != day) {
+			this->days.emplace_back();
+			this->days.back().day = day;
+		}
+	}
+
+	// Times run as the phase of the current day, counted holds the running totals of the model
+	template <class Run>
+	void Measure(metric_phase_t phase, const phase_counters_t& counted, Run&& run){
+		if (this->days.empty()) this->StartDay(0);
+		const phase_counters_t before = counted;
+		const perf_values_t perf_before = this->perf.IsOpen() ? this->perf.Read() : perf_values_t();
+		const clock::time_point start = clock::now();
+		run();
+		phase_metrics_t& metrics = this->days.back().phases[phase];
+		metrics.ns += Elapsed(start);
+		if (this->perf.IsOpen()) metrics.perf += this->perf.Read() - perf_before;
+		metrics.counted += counted - before;
+		++metrics.calls;
+	}
+
+	/* Writing of the given day by the output thread
+	 * - Kept apart from the days, so the simulating thread can go on meanwhile */
+	void AddOutput(unsigned int day, double ns){
+		if (this->output_ns.size() <= day) this->output_ns.resize(day + 1, 0.0);
+		this->output_ns[day] += ns;
+	}
+
+	static double Elapsed(clock::time_point start){
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+	}
+
+	/* Writes the metrics of every day and their totals
+	 * - Must be called after the output thread finished */
+	bool Write(const std::string& filename, const std::string& engine){
+		std::ofstream file(filename);
+		if (!file.is_open()) return false;
+		file << std::fixed << std::setprecision(0);
+
+		for (day_metrics_t& day : this->days) {
+			if (day.day < this->output_ns.size() && this->output_ns[day.day] > 0) {
+				day.phases[METRIC_OUTPUT].ns += this->output_ns[day.day];
+				++day.phases[METRIC_OUTPUT].calls;
+			}
+		}
+
+		file << "{\"engine\":\"" << engine << "\",\n\"total\":";
+		this->WritePhases(file, this->Total());
+		file << ",\n\"days\":[";
+		for (size_t d = 0; d < this->days.size(); ++d) {
+			file << (d ? ",\n" : "\n") << "{\"day\":" << this->days[d].day << ",\"phases\":";
+			this->WritePhases(file, this->days[d]);
+			file << "}";
+		}
+		file << "\n]}\n";
+		return (bool)file;
+	}
+
+	// Table of the hardware counters of every phase over the whole run
+	void WritePerfSummary(std::ostream& out) const{
+		const day_metrics_t total = this->Total();
+		out << "Hardware counters per phase (" << (this->perf.IsOpen() ? "user space" : "unavailable: " + this->perf.Error()) << ")" << std::endl;
+		if (!this->perf.IsOpen()) return;
+		out << "  Phase           " << std::setw(12) << "ms";
+		for (unsigned int c = 0; c < N_OF_PERF_COUNTERS; ++c) out << std::setw(16) << perf_counter_names[c];
+		out << std::setw(8) << "IPC" << std::setw(16) << "br_miss/kinstr" << std::endl;
+		for (unsigned int p = 0; p < METRIC_OUTPUT; ++p) {
+			const phase_metrics_t& phase = total.phases[p];
+			const uint64_t* values = phase.perf.values;
+			out << "  " << std::left << std::setw(16) << metric_phase_names[p] << std::right
+				<< std::fixed << std::setprecision(2) << std::setw(12) << phase.ns / 1e6;
+			for (unsigned int c = 0; c < N_OF_PERF_COUNTERS; ++c) {
+				if (this->perf.Available((perf_counter_t)c)) out << std::setw(16) << values[c];
+				else out << std::setw(16) << "-";
+			}
+			out << std::setw(8) << (values[PERF_CYCLES] ? (double)values[PERF_INSTRUCTIONS] / values[PERF_CYCLES] : 0.0)
+				<< std::setw(16) << (values[PERF_INSTRUCTIONS] ? 1000.0 * values[PERF_BRANCH_MISSES] / values[PERF_INSTRUCTIONS] : 0.0)
+				<< std::endl;
+		}
+	}
+
+private:
+	std::vector<day_metrics_t> days;
+	std::vector<double> output_ns;
+	PerfCounters perf;
+
+	day_metrics_t Total() const{
+		day_metrics_t total;
+		for (const day_metrics_t& day : this->days) {
+			for (unsigned int p = 0; p < N_OF_METRIC_PHASES; ++p) total.phases[p] += day.phases[p];
+		}
+		return total;
+	}
+
+	void WritePhases(std::ostream& out, const day_metrics_t& day) const{
+		double ns = 0;
+		out << "{";
+		for (unsigned int p = 0; p < N_OF_METRIC_PHASES; ++p) {
+			const phase_metrics_t& phase = day.phases[p];
+			ns += phase.ns;
+			out << (p ? "," : "") << "\"" << metric_phase_names[p] << "\":{\"calls\":" << phase.calls << ",\"ns\":" << phase.ns
+				<< ",\"draws\":" << phase.counted.draws << ",\"groups\":" << phase.counted.groups
+				<< ",\"infections\":" << phase.counted.infections << ",\"admissions\":" << phase.counted.admissions
+				<< ",\"deaths\":" << phase.counted.deaths;
+			// The output is written by another thread
+			for (unsigned int c = 0; c < N_OF_PERF_COUNTERS && p != METRIC_OUTPUT; ++c) {
+				if (this->perf.Available((perf_counter_t)c)) out << ",\"" << perf_counter_names[c] << "\":" << phase.perf.values[c];
+			}
+			out << "}";
+		}
+		out << ",\"ns\":" << ns << "}";
+	}
+};
+
+/* Runs a phase of a model, measured when there are metrics to collect */
+template <class Run>
+inline void Measured(RunMetrics* metrics, metric_phase_t phase, const phase_counters_t& counted, Run&& run){
+	if (!metrics) run();
+	else metrics->Measure(phase, counted, run);
+}
+
+#endif //IMS_METRICS_H
@@ -0,0 +1,127 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_PERF_COUNTERS_H
+#define IMS_PERF_COUNTERS_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Hardware performance counters of the calling thread (Linux perf_event_open)
+ * - Cycles, instructions, branch misses and cache misses are opened as one group, so they are read at once
+ *   and always count over the same interval
+ * - Counting is limited to user space, which works under the default perf_event_paranoid setting
+ * - Counters the kernel, the CPU or the container refuses are reported as unavailable and the rest still count,
+ *   when none can be opened Open() returns false and says why in Error() */
+
+enum perf_counter_t { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_CACHE_MISSES, N_OF_PERF_COUNTERS };
+const char* const perf_counter_names[N_OF_PERF_COUNTERS] = {"cycles", "instructions", "branch_misses", "cache_misses"};
+
+struct perf_values_t {
+	uint64_t values[N_OF_PERF_COUNTERS] = {};
+
+	perf_values_t operator-(const perf_values_t& other) const{
+		perf_values_t difference;
+		for (unsigned int c = 0; c < N_OF_PERF_COUNTERS; ++c) difference.values[c] = this->values[c] - other.values[c];
+		return difference;
+	}
+	perf_values_t& operator+=(const perf_values_t& other){
+		for (unsigned int c = 0; c < N_OF_PERF_COUNTERS; ++c) this->values[c] += other.values[c];
+		return *this;
+	}
+};
+
+class PerfCounters {
+public:
+	PerfCounters() = default;
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+	~PerfCounters(){ this->Close(); }
+
+	bool Open(){
+		this->Close();
+#ifdef __linux__
+		const uint64_t configs[N_OF_PERF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+													  PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+		for (unsigned int c = 0; c < N_OF_PERF_COUNTERS; ++c) {
+			perf_event_attr attributes;
+			memset(&attributes, 0, sizeof(attributes));
+			attributes.size = sizeof(attributes);
+			attributes.type = PERF_TYPE_HARDWARE;
+			attributes.config = configs[c];
+			attributes.disabled = this->leader < 0;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			attributes.read_format = PERF_FORMAT_GROUP;
+			const int fd = syscall(SYS_perf_event_open, &attributes, 0, -1, this->leader, 0);
+			if (fd < 0) {
+				if (this->error.empty()) this->error = std::string(perf_counter_names[c]) + ": " + strerror(errno);
+				continue;
+			}
+			if (this->leader < 0) this->leader = fd;
+			this->fds[c] = fd;
+			this->slot[c] = this->n_of_open++;
+		}
+		if (this->leader < 0) return false;
+		ioctl(this->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(this->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		return true;
+#else
+		this->error = "hardware counters are only supported on Linux";
+		return false;
+#endif
+	}
+
+	bool IsOpen() const { return this->leader >= 0; }
+	bool Available(perf_counter_t counter) const { return this->fds[counter] >= 0; }
+	// Why the first counter that couldn't be opened was refused
+	const std::string& Error() const { return this->error; }
+
+	// Current values since Open(), unavailable counters stay at zero
+	perf_values_t Read() const{
+		perf_values_t read;
+#ifdef __linux__
+		uint64_t buffer[1 + N_OF_PERF_COUNTERS];
+		if (this->leader < 0 || ::read(this->leader, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t)) return read;
+		for (unsigned int c = 0; c < N_OF_PERF_COUNTERS; ++c) {
+			if (this->fds[c] >= 0 && this->slot[c] < buffer[0]) read.values[c] = buffer[1 + this->slot[c]];
+		}
+#endif
+		return read;
+	}
+
+	void Close(){
+#ifdef __linux__
+		for (int& fd : this->fds) {
+			if (fd >= 0) close(fd);
+			fd = -1;
+		}
+#endif
+		this->leader = -1;
+		this->n_of_open = 0;
+	}
+
+private:
+	int leader = -1;
+	int fds[N_OF_PERF_COUNTERS] = {-1, -1, -1, -1};
+	// Position of each counter in a group read
+	unsigned int slot[N_OF_PERF_COUNTERS] = {};
+	unsigned int n_of_open = 0;
+	std::string error;
+};
+
+#endif //IMS_PERF_COUNTERS_H
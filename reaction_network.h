@@ -0,0 +1,356 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_REACTION_NETWORK_H
+#define IMS_REACTION_NETWORK_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "sampling.h"
+
+/* Continuous time stochastic simulation over compartments
+ * - A ReactionNetwork lists its reactions, what each changes and which compartments its propensity reads,
+ *   from which it derives the reactions whose propensities an event invalidates
+ * - Propensities themselves are supplied by the model, as they need not be mass action */
+
+struct reaction_t {
+	// Compartment and by how many people it changes when the reaction fires
+	std::vector<std::pair<unsigned int, int64_t>> changes;
+	// Compartments the propensity depends on
+	std::vector<unsigned int> reads;
+};
+
+class ReactionNetwork {
+public:
+	explicit ReactionNetwork(unsigned int n_of_compartments = 0) : n_of_compartments(n_of_compartments) {}
+
+	unsigned int Compartments() const { return this->n_of_compartments; }
+	unsigned int Reactions() const { return this->reactions.size(); }
+	const reaction_t& Reaction(unsigned int r) const { return this->reactions[r]; }
+
+	unsigned int Add(const reaction_t& reaction){
+		this->reactions.push_back(reaction);
+		this->dependents.clear();
+		return this->reactions.size() - 1;
+	}
+
+	// Reactions whose propensity changes when r fires, r itself included
+	const std::vector<unsigned int>& Dependents(unsigned int r){
+		if (this->dependents.empty()) this->FindDependents();
+		return this->dependents[r];
+	}
+
+	// Applies the reaction fired the given number of times to the compartments
+	template <class Counts>
+	void Fire(unsigned int r, Counts& counts, int64_t times = 1) const{
+		for (const auto& change : this->reactions[r].changes) counts[change.first] += change.second * times;
+	}
+
+private:
+	unsigned int n_of_compartments;
+	std::vector<reaction_t> reactions;
+	std::vector<std::vector<unsigned int>> dependents;
+
+	void FindDependents(){
+		std::vector<std::vector<unsigned int>> readers(this->n_of_compartments);
+		for (unsigned int r = 0; r < this->reactions.size(); ++r) {
+			for (unsigned int c : this->reactions[r].reads) readers[c].push_back(r);
+		}
+		this->dependents.assign(this->reactions.size(), std::vector<unsigned int>());
+		for (unsigned int r = 0; r < this->reactions.size(); ++r) {
+			std::vector<unsigned int>& dependent = this->dependents[r];
+			dependent.push_back(r);
+			for (const auto& change : this->reactions[r].changes) {
+				dependent.insert(dependent.end(), readers[change.first].begin(), readers[change.first].end());
+			}
+			std::sort(dependent.begin(), dependent.end());
+			dependent.erase(std::unique(dependent.begin(), dependent.end()), dependent.end());
+		}
+	}
+};
+
+/* Binary min-heap of the next firing times of the reactions that knows where every reaction sits,
+ * so the time of any reaction can be changed in O(log R) */
+class IndexedHeap {
+public:
+	void Assign(const std::vector<double>& times){
+		this->times = times;
+		this->heap.resize(times.size());
+		this->position.resize(times.size());
+		for (unsigned int r = 0; r < times.size(); ++r) this->heap[r] = this->position[r] = r;
+		for (unsigned int i = times.size() / 2; i-- > 0;) this->Down(i);
+	}
+
+	unsigned int Top() const { return this->heap[0]; }
+	double Time(unsigned int r) const { return this->times[r]; }
+	bool Empty() const { return this->heap.empty(); }
+
+	void Update(unsigned int r, double time){
+		const double previous = this->times[r];
+		this->times[r] = time;
+		if (time < previous) this->Up(this->position[r]);
+		else this->Down(this->position[r]);
+	}
+
+private:
+	std::vector<double> times;
+	std::vector<unsigned int> heap, position;
+
+	void Swap(unsigned int i, unsigned int j){
+		std::swap(this->heap[i], this->heap[j]);
+		this->position[this->heap[i]] = i;
+		this->position[this->heap[j]] = j;
+	}
+	void Up(unsigned int i){
+		while (i > 0 && this->times[this->heap[(i - 1) / 2]] > this->times[this->heap[i]]) {
+			this->Swap(i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+	}
+	void Down(unsigned int i){
+		while (true) {
+			unsigned int smallest = i;
+			for (unsigned int child = 2 * i + 1; child <= 2 * i + 2 && child < this->heap.size(); ++child) {
+				if (this->times[this->heap[child]] < this->times[this->heap[smallest]]) smallest = child;
+			}
+			if (smallest == i) return;
+			this->Swap(i, smallest);
+			i = smallest;
+		}
+	}
+};
+
+/* Exact stochastic simulation by the Next Reaction Method (Gibson & Bruck 2000)
+ * - Every reaction keeps the absolute time it fires next, the earliest one is at the top of an IndexedHeap
+ * - After an event only the dependent reactions get new propensities, their remaining waiting times are rescaled
+ *   by old / new propensity instead of being drawn again, so an event costs O(D log R) for D dependents
+ * - Model provides double Propensity(unsigned int reaction) const and the compartment counts it reads */
+class NextReactionMethod {
+public:
+	static constexpr double never = std::numeric_limits<double>::infinity();
+
+	// Draws the first firing times of all reactions from time
+	template <class Model, class Engine>
+	void Start(const ReactionNetwork& network, const Model& model, double time, Engine& engine){
+		this->time = time;
+		this->propensities.resize(network.Reactions());
+		std::vector<double> times(network.Reactions());
+		for (unsigned int r = 0; r < network.Reactions(); ++r) {
+			this->propensities[r] = model.Propensity(r);
+			times[r] = this->FiringTime(this->propensities[r], engine);
+		}
+		this->heap.Assign(times);
+	}
+
+	/* Fires reactions while the next one comes before until, returns the number of events
+	 * - fire(r) applies the reaction to the model, the dependents of r are refreshed after it returns
+	 * - When fire() changes further compartments (an immediate follow-up such as an admission), it refreshes
+	 *   the reactions depending on them itself through Refresh() */
+	template <class Model, class Engine, class Fire>
+	uint64_t RunUntil(ReactionNetwork& network, Model& model, double until, Engine& engine, const Fire& fire){
+		uint64_t events = 0;
+		while (!this->heap.Empty() && this->heap.Time(this->heap.Top()) < until) {
+			const unsigned int fired = this->heap.Top();
+			this->time = this->heap.Time(fired);
+			fire(fired);
+			++events;
+			this->Refresh(network.Dependents(fired), fired, model, engine);
+		}
+		this->time = until;
+		return events;
+	}
+
+	/* Recomputes the propensities of the given reactions after the model changed outside of RunUntil
+	 * - fired, if it is one of them, gets a fresh waiting time */
+	template <class Model, class Engine>
+	void Refresh(const std::vector<unsigned int>& reactions, unsigned int fired, const Model& model, Engine& engine){
+		for (unsigned int r : reactions) {
+			const double previous = this->propensities[r];
+			const double propensity = model.Propensity(r);
+			this->propensities[r] = propensity;
+			if (r == fired || previous <= 0.0 || !std::isfinite(this->heap.Time(r))) {
+				this->heap.Update(r, this->FiringTime(propensity, engine));
+			}
+			else if (propensity <= 0.0) {
+				this->heap.Update(r, never);
+			}
+			else if (propensity != previous) {
+				this->heap.Update(r, this->time + (previous / propensity) * (this->heap.Time(r) - this->time));
+			}
+		}
+	}
+
+	double Time() const { return this->time; }
+	// Next firing time of every reaction, together with Time() all the state of the method
+	std::vector<double> FiringTimes() const{
+		std::vector<double> times(this->propensities.size());
+		for (unsigned int r = 0; r < times.size(); ++r) times[r] = this->heap.Time(r);
+		return times;
+	}
+	// Continues from saved firing times
+	template <class Model>
+	void Restore(const ReactionNetwork& network, const Model& model, double time, const std::vector<double>& times){
+		this->time = time;
+		this->propensities.resize(network.Reactions());
+		for (unsigned int r = 0; r < network.Reactions(); ++r) this->propensities[r] = model.Propensity(r);
+		this->heap.Assign(times);
+	}
+
+private:
+	double time = 0.0;
+	std::vector<double> propensities;
+	IndexedHeap heap;
+
+	template <class Engine>
+	double FiringTime(double propensity, Engine& engine) const{
+		if (propensity <= 0.0) return never;
+		return this->time - std::log1p(-UniformReal(engine)) / propensity;
+	}
+};
+
+/* Approximate stochastic simulation by adaptive tau-leaping (Cao, Gillespie & Petzold 2006)
+ * - A leap fires every reaction a Poisson number of times for its propensity at the start of the leap,
+ *   the leap is as long as the expected change of every compartment it consumes stays within epsilon of its count
+ * - Critical reactions, which could empty a compartment in fewer than critical_firings firings, are not leapt,
+ *   at most one of them fires per leap, at an exponential time as in the exact method
+ * - When a leap would cover fewer than exact_events events, exact steps of the direct method are taken instead,
+ *   so nearly empty compartments evolve exactly
+ * - A leap that would still make a compartment negative is halved and drawn again
+ * - Holds no state between calls besides scratch space, the time is the caller's */
+class TauLeaping {
+public:
+	double epsilon = 0.03;
+	int64_t critical_firings = 10;
+	double exact_events = 10.0;
+	unsigned int exact_steps = 100;
+
+	/* Simulates from time until until, returns the number of events
+	 * - fire(r, times) applies the reaction fired the given number of times to the model, which may change further
+	 *   compartments meanwhile (e.g. an immediate follow-up), propensities are read again after every step */
+	template <class Model, class Counts, class Engine, class Fire>
+	uint64_t RunUntil(const ReactionNetwork& network, const Model& model, const Counts& counts, double time, double until,
+					  Engine& engine, const Fire& fire){
+		uint64_t events = 0;
+		this->firings.resize(network.Reactions());
+		while (time < until) {
+			double total = this->Propensities(network, model);
+			if (total <= 0.0) break;
+
+			double leap = this->LeapTime(network, counts);
+			if (leap * total < this->exact_events) {
+				// Direct method: exponential waiting times of all reactions together, the reaction chosen by propensity
+				for (unsigned int step = 0; step < this->exact_steps && total > 0.0; ++step) {
+					time -= std::log1p(-UniformReal(engine)) / total;
+					if (time >= until) break;
+					fire(this->Pick(UniformReal(engine) * total, false), 1);
+					++events;
+					total = this->Propensities(network, model);
+				}
+				continue;
+			}
+
+			double critical_total = 0.0;
+			for (unsigned int r = 0; r < network.Reactions(); ++r) {
+				if (this->critical[r]) critical_total += this->propensities[r];
+			}
+			const double critical_time = critical_total > 0.0 ? -std::log1p(-UniformReal(engine)) / critical_total
+															  : std::numeric_limits<double>::infinity();
+			while (true) {
+				const double tau = std::min({leap, critical_time, until - time});
+				this->scratch.assign(counts.begin(), counts.end());
+				for (unsigned int r = 0; r < network.Reactions(); ++r) {
+					this->firings[r] = this->critical[r] ? 0 : Poisson(engine, this->propensities[r] * tau);
+				}
+				if (critical_time <= tau) ++this->firings[this->Pick(UniformReal(engine) * critical_total, true)];
+				for (unsigned int r = 0; r < network.Reactions(); ++r) network.Fire(r, this->scratch, this->firings[r]);
+
+				if (std::all_of(this->scratch.begin(), this->scratch.end(), [](int64_t count){ return count >= 0; })) {
+					time += tau;
+					for (unsigned int r = 0; r < network.Reactions(); ++r) {
+						if (!this->firings[r]) continue;
+						fire(r, this->firings[r]);
+						events += this->firings[r];
+					}
+					break;
+				}
+				leap /= 2.0;
+			}
+		}
+		return events;
+	}
+
+private:
+	std::vector<double> propensities;
+	std::vector<bool> critical;
+	std::vector<int64_t> firings, scratch;
+	// Expected change and its variance per compartment over a unit of time
+	std::vector<double> drift, variance;
+
+	template <class Model>
+	double Propensities(const ReactionNetwork& network, const Model& model){
+		this->propensities.resize(network.Reactions());
+		double total = 0.0;
+		for (unsigned int r = 0; r < network.Reactions(); ++r) {
+			this->propensities[r] = std::max(model.Propensity(r), 0.0);
+			total += this->propensities[r];
+		}
+		return total;
+	}
+
+	// Reaction at the cumulative propensity target, among the critical ones only or all
+	unsigned int Pick(double target, bool only_critical) const{
+		unsigned int last = 0;
+		for (unsigned int r = 0; r < this->propensities.size(); ++r) {
+			if (this->propensities[r] <= 0.0 || (only_critical && !this->critical[r])) continue;
+			last = r;
+			if (target < this->propensities[r]) return r;
+			target -= this->propensities[r];
+		}
+		return last;
+	}
+
+	/* Longest leap keeping the expected change and the deviation of every consumed compartment within
+	 * max(epsilon * count, 1), marks the critical reactions meanwhile */
+	template <class Counts>
+	double LeapTime(const ReactionNetwork& network, const Counts& counts){
+		this->critical.assign(network.Reactions(), false);
+		this->drift.assign(network.Compartments(), 0.0);
+		this->variance.assign(network.Compartments(), 0.0);
+		for (unsigned int r = 0; r < network.Reactions(); ++r) {
+			if (this->propensities[r] <= 0.0) continue;
+			for (const auto& change : network.Reaction(r).changes) {
+				if (change.second < 0 && counts[change.first] / -change.second < this->critical_firings) this->critical[r] = true;
+			}
+			if (this->critical[r]) continue;
+			for (const auto& change : network.Reaction(r).changes) {
+				this->drift[change.first] += change.second * this->propensities[r];
+				this->variance[change.first] += (double)change.second * change.second * this->propensities[r];
+			}
+		}
+
+		double leap = std::numeric_limits<double>::infinity();
+		for (unsigned int r = 0; r < network.Reactions(); ++r) {
+			if (this->critical[r] || this->propensities[r] <= 0.0) continue;
+			for (const auto& change : network.Reaction(r).changes) {
+				if (change.second >= 0) continue;
+				const unsigned int c = change.first;
+				const double bound = std::max(this->epsilon * counts[c], 1.0);
+				if (this->drift[c] != 0.0) leap = std::min(leap, bound / std::fabs(this->drift[c]));
+				if (this->variance[c] > 0.0) leap = std::min(leap, bound * bound / this->variance[c]);
+			}
+		}
+		return leap;
+	}
+};
+
+#endif //IMS_REACTION_NETWORK_H
@@ -0,0 +1,68 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_RESIDENCE_H
+#define IMS_RESIDENCE_H
+
+#include <algorithm>
+#include <vector>
+
+/* Number of people in a compartment by the number of days they have spent in it
+ * - (*this)[d] are the people who entered d days ago, new arrivals are added to (*this)[0]
+ * - The last tracked day also collects everyone who stayed longer than that
+ * - Kept in a ring buffer, so advancing a day only moves the head: O(1) regardless of the number of tracked days */
+template <class T>
+class ResidenceHistogram {
+public:
+	explicit ResidenceHistogram(unsigned int n_of_days = 1)
+		: counts(n_of_days ? n_of_days : 1, T()), head(0) {}
+
+	T& operator[](unsigned int days){
+		return this->counts[this->Index(days)];
+	}
+	const T& operator[](unsigned int days) const{
+		return this->counts[this->Index(days)];
+	}
+
+	unsigned int Days() const{
+		return this->counts.size();
+	}
+
+	// Changes the number of tracked days, people past the new last day join it
+	void Resize(unsigned int n_of_days){
+		ResidenceHistogram resized(n_of_days);
+		for (unsigned int days = 0; days < this->Days(); ++days) {
+			resized[std::min(days, resized.Days() - 1)] += (*this)[days];
+		}
+		*this = resized;
+	}
+
+	/* Everyone spent one more day in the compartment
+	 * - The people on the last tracked day stay there, the ones before them join them
+	 * - The bucket of the new arrivals is reused from the freed slot and starts empty */
+	void Advance(){
+		const unsigned int n_of_days = this->counts.size();
+		if (n_of_days == 1) return;
+		const unsigned int last = this->Index(n_of_days - 1);
+		this->counts[this->Index(n_of_days - 2)] += this->counts[last];
+		this->counts[last] = T();
+		this->head = last;
+	}
+
+private:
+	std::vector<T> counts;
+	// Position of the people who entered today
+	unsigned int head;
+
+	unsigned int Index(unsigned int days) const{
+		unsigned int index = this->head + days;
+		return index < this->counts.size() ? index : index - this->counts.size();
+	}
+};
+
+#endif //IMS_RESIDENCE_H
@@ -0,0 +1,107 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_RNG_H
+#define IMS_RNG_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+/* Counter based random number generation
+ * - A generator is a keyed bijection of a 128 bit counter, so any word of any stream can be computed directly
+ * - Streams are keyed by (replicate, day, phase), which makes the random numbers a phase consumes independent
+ *   of how many numbers other phases, days or replicates consumed and of the thread they run on */
+
+/* Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", 2011) */
+struct Philox4x32 {
+	typedef std::array<uint32_t, 4> counter_t;
+	typedef std::array<uint32_t, 2> key_t;
+
+	static counter_t Block(counter_t ctr, key_t key){
+		for (unsigned int round = 0; round < 10; ++round) {
+			const uint64_t product0 = (uint64_t)0xD2511F53u * ctr[0];
+			const uint64_t product1 = (uint64_t)0xCD9E8D57u * ctr[2];
+			ctr = {(uint32_t)(product1 >> 32) ^ ctr[1] ^ key[0], (uint32_t)product1,
+				   (uint32_t)(product0 >> 32) ^ ctr[3] ^ key[1], (uint32_t)product0};
+			key[0] += 0x9E3779B9u;
+			key[1] += 0xBB67AE85u;
+		}
+		return ctr;
+	}
+};
+
+// Which part of the simulation day a stream of random numbers belongs to
+enum class phase_t : uint32_t { setup, interactions, home_quarantine, illness, hospital, mobility, reactions };
+
+/* Sequence of 32 bit words produced by a counter based generator for one (replicate, day, phase) key
+ * - Satisfies UniformRandomBitGenerator, so it can drive the samplers in sampling.h
+ * - The substream allows a phase to be split further (e.g. one stream per worker) */
+template <class Generator>
+class CounterStream {
+public:
+	typedef uint32_t result_type;
+
+	CounterStream(uint64_t seed, uint32_t replicate, uint32_t day, phase_t phase, uint32_t substream = 0){
+		this->key = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+		this->counter = {0, (uint32_t)phase | (substream << 8), day, replicate};
+		this->position = 4;
+		this->draws = 0;
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()(){
+		if (this->position == 4) {
+			this->block = Generator::Block(this->counter, this->key);
+			++this->counter[0];
+			this->position = 0;
+		}
+		++this->draws;
+		return this->block[this->position++];
+	}
+
+	// Returns a uniformly distributed number from [0, bound) without modulo bias (Lemire 2019)
+	uint32_t Below(uint32_t bound){
+		uint64_t product = (uint64_t)(*this)() * bound;
+		if ((uint32_t)product < bound) {
+			const uint32_t rejection_limit = (uint32_t)(-bound) % bound;
+			while ((uint32_t)product < rejection_limit) {
+				product = (uint64_t)(*this)() * bound;
+			}
+		}
+		return (uint32_t)(product >> 32);
+	}
+
+	// Succeeds with chance threshold / 2^32, see Threshold()
+	bool Bernoulli(uint64_t threshold){
+		return (*this)() < threshold;
+	}
+
+	// Number of words consumed from this stream so far
+	uint64_t Draws() const { return this->draws; }
+
+private:
+	typename Generator::key_t key;
+	typename Generator::counter_t counter;
+	typename Generator::counter_t block;
+	unsigned int position;
+	uint64_t draws;
+};
+
+typedef CounterStream<Philox4x32> RandomStream;
+
+// Converts a chance from [0, 1] to an integer threshold for RandomStream::Bernoulli
+inline uint64_t Threshold(double probability){
+	if (probability <= 0.0) return 0;
+	if (probability >= 1.0) return (uint64_t)1 << 32;
+	return (uint64_t)(probability * 4294967296.0 + 0.5);
+}
+
+#endif //IMS_RNG_H
@@ -0,0 +1,196 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_SAMPLING_H
+#define IMS_SAMPLING_H
+
+#include <cmath>
+#include <cstdint>
+
+/* Random variates drawn from any uniform random bit generator producing 32 bit words
+ * - Used by the aggregate engine to resolve whole compartments in a single draw and by tau-leaping
+ * - All samplers run in O(1) expected time regardless of the number of trials */
+
+// Returns a double from [0, 1) with 53 bits of precision
+template <class Engine>
+double UniformReal(Engine& engine){
+	uint64_t a = (uint64_t)(engine() & 0xffffffffu) >> 5;
+	uint64_t b = (uint64_t)(engine() & 0xffffffffu) >> 6;
+	return (double)(a * 67108864u + b) / 9007199254740992.0;
+}
+
+/* Number of successes in n independent trials with success chance p
+ * - Small means are resolved by sequential inversion
+ * - Large means use the transformed rejection method (BTRS, Hörmann 1993) */
+template <class Engine>
+uint64_t Binomial(Engine& engine, uint64_t n, double p){
+	if (n == 0 || p <= 0.0) return 0;
+	if (p >= 1.0) return n;
+	// The sampler below expects the success chance to be at most 50%
+	if (p > 0.5) return n - Binomial(engine, n, 1.0 - p);
+
+	const double q = 1.0 - p;
+	const double mean = (double)n * p;
+
+	if (mean < 10.0) {
+		const double s = p / q;
+		const double a = ((double)n + 1.0) * s;
+		const double r0 = std::exp((double)n * std::log1p(-p));
+		while (true) {
+			double r = r0;
+			double u = UniformReal(engine);
+			uint64_t x = 0;
+			while (u > r) {
+				u -= r;
+				++x;
+				// Numerical leftovers can push the search past n, start over
+				if (x > n) break;
+				r *= (a / (double)x - s);
+			}
+			if (x <= n) return x;
+		}
+	}
+
+	const double spq = std::sqrt(mean * q);
+	const double b = 1.15 + 2.53 * spq;
+	const double a = -0.0873 + 0.0248 * b + 0.01 * p;
+	const double c = mean + 0.5;
+	const double v_r = 0.92 - 4.2 / b;
+	const double alpha = (2.83 + 5.1 / b) * spq;
+	const double lpq = std::log(p / q);
+	const double m = std::floor(((double)n + 1.0) * p);
+	const double h = std::lgamma(m + 1.0) + std::lgamma((double)n - m + 1.0);
+
+	while (true) {
+		double u = UniformReal(engine) - 0.5;
+		double v = UniformReal(engine);
+		double us = 0.5 - std::fabs(u);
+		double k = std::floor((2.0 * a / us + b) * u + c);
+		if (k < 0.0 || k > (double)n) continue;
+		if (us >= 0.07 && v <= v_r) return (uint64_t)k;
+
+		v = std::log(v * alpha / (a / (us * us) + b));
+		if (v <= h - std::lgamma(k + 1.0) - std::lgamma((double)n - k + 1.0) + (k - m) * lpq)
+			return (uint64_t)k;
+	}
+}
+
+/* Number of events of a Poisson process with the given mean
+ * - Small means are resolved by sequential inversion
+ * - Large means use the transformed rejection method (PTRS, Hörmann 1993) */
+template <class Engine>
+uint64_t Poisson(Engine& engine, double mean){
+	if (mean <= 0.0) return 0;
+
+	if (mean < 10.0) {
+		const double r0 = std::exp(-mean);
+		while (true) {
+			double r = r0;
+			double u = UniformReal(engine);
+			uint64_t x = 0;
+			while (u > r && r > 0.0) {
+				u -= r;
+				++x;
+				r *= mean / (double)x;
+			}
+			// Numerical leftovers can exhaust the probabilities, start over
+			if (u <= r) return x;
+		}
+	}
+
+	const double slam = std::sqrt(mean);
+	const double loglam = std::log(mean);
+	const double b = 0.931 + 2.53 * slam;
+	const double a = -0.059 + 0.02483 * b;
+	const double invalpha = 1.1239 + 1.1328 / (b - 3.4);
+	const double v_r = 0.9277 - 3.6224 / (b - 2.0);
+
+	while (true) {
+		double u = UniformReal(engine) - 0.5;
+		double v = UniformReal(engine);
+		double us = 0.5 - std::fabs(u);
+		double k = std::floor((2.0 * a / us + b) * u + mean + 0.43);
+		if (us >= 0.07 && v <= v_r) return (uint64_t)k;
+		if (k < 0.0 || (us < 0.013 && v > us)) continue;
+		if (std::log(v) + std::log(invalpha) - std::log(a / (us * us) + b) <= -mean + k * loglam - std::lgamma(k + 1.0))
+			return (uint64_t)k;
+	}
+}
+
+/* Splits n trials into three outcomes with chances p_first, p_second and the rest
+ * - Resolved as a binomial for the first outcome and a conditional binomial for the second */
+template <class Engine>
+void Trinomial(Engine& engine, uint64_t n, double p_first, double p_second, uint64_t& first, uint64_t& second){
+	first = Binomial(engine, n, p_first);
+	const double left = 1.0 - p_first;
+	second = (left > 0.0) ? Binomial(engine, n - first, p_second / left) : 0;
+}
+
+/* Number of marked items among sample items drawn without replacement from marked + unmarked items
+ * - Small samples are resolved by the inversion algorithm (HYP)
+ * - Large samples use the ratio of uniforms method (HRUA, Stadlober 1989) */
+template <class Engine>
+uint64_t Hypergeometric(Engine& engine, uint64_t marked, uint64_t unmarked, uint64_t sample){
+	const uint64_t population = marked + unmarked;
+	if (sample == 0 || marked == 0) return 0;
+	if (unmarked == 0) return sample < marked ? sample : marked;
+	if (sample >= population) return marked;
+
+	if (sample <= 10) {
+		const double d1 = (double)(population - sample);
+		double y = (double)(marked < unmarked ? marked : unmarked);
+		const double d2 = y;
+		double k = (double)sample;
+		while (y > 0.0) {
+			y -= std::floor(UniformReal(engine) + y / (d1 + k));
+			k -= 1.0;
+			if (k == 0.0) break;
+		}
+		uint64_t z = (uint64_t)(d2 - y);
+		return marked > unmarked ? sample - z : z;
+	}
+
+	const double D1 = 1.7155277699214135;
+	const double D2 = 0.8989161620588988;
+	const double min_marked = (double)(marked < unmarked ? marked : unmarked);
+	const double max_marked = (double)(marked < unmarked ? unmarked : marked);
+	const double total = (double)population;
+	const double m = (double)(sample < population - sample ? sample : population - sample);
+	const double d4 = min_marked / total;
+	const double d5 = 1.0 - d4;
+	const double d6 = m * d4 + 0.5;
+	const double d7 = std::sqrt((total - m) * (double)sample * d4 * d5 / (total - 1.0) + 0.5);
+	const double d8 = D1 * d7 + D2;
+	const double d9 = std::floor((m + 1.0) * (min_marked + 1.0) / (total + 2.0));
+	const double d10 = std::lgamma(d9 + 1.0) + std::lgamma(min_marked - d9 + 1.0)
+					 + std::lgamma(m - d9 + 1.0) + std::lgamma(max_marked - m + d9 + 1.0);
+	const double d11 = std::fmin(std::fmin(m, min_marked) + 1.0, std::floor(d6 + 16.0 * d7));
+
+	double z;
+	while (true) {
+		double x = UniformReal(engine);
+		double y = UniformReal(engine);
+		if (x == 0.0) continue;
+		double w = d6 + d8 * (y - 0.5) / x;
+		if (w < 0.0 || w >= d11) continue;
+
+		z = std::floor(w);
+		double t = d10 - (std::lgamma(z + 1.0) + std::lgamma(min_marked - z + 1.0)
+						+ std::lgamma(m - z + 1.0) + std::lgamma(max_marked - m + z + 1.0));
+		if (x * (4.0 - x) - 3.0 <= t) break;
+		if (x * (x - t) >= 1.0) continue;
+		if (2.0 * std::log(x) <= t) break;
+	}
+
+	// Undo the symmetry reductions used above
+	if (marked > unmarked) z = m - z;
+	if (m < (double)sample) z = (double)marked - z;
+	return (uint64_t)z;
+}
+
+#endif //IMS_SAMPLING_H
@@ -0,0 +1,228 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_SERIES_FILE_H
+#define IMS_SERIES_FILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "timeseries.h"
+
+/* Binary columnar file with the daily values of one or more replicates
+ * - Layout: header, metric names, number of days stored per replicate, then for every replicate and metric
+ *   a column of doubles preallocated for capacity days (native byte order)
+ * - Days are buffered per replicate and written a block at a time, one pwrite per metric, and the day count is
+ *   bumped afterwards, so a reader never sees a day whose values are not there yet (Close() writes the last block)
+ * - Replicates own disjoint columns and counts, so they can be written from different threads */
+
+struct series_file_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_of_metrics, n_of_replicates, capacity;
+	// Offset of the first column, a multiple of 64
+	uint64_t data_offset;
+};
+
+const char series_file_magic[8] = {'I', 'M', 'S', 'S', 'E', 'R', 'I', 'E'};
+const uint32_t series_file_version = 1;
+const unsigned int series_file_name_length = 32;
+// Days a writer collects before writing them
+const unsigned int series_file_block_days = 32;
+
+/* Streams days into a series file */
+class SeriesFileWriter {
+public:
+	SeriesFileWriter() = default;
+	SeriesFileWriter(const SeriesFileWriter&) = delete;
+	SeriesFileWriter& operator=(const SeriesFileWriter&) = delete;
+	~SeriesFileWriter(){ this->Close(); }
+
+	/* Creates the file with room for capacity days of every replicate
+	 * - Returns false when the file can't be created */
+	bool Open(const std::string& filename, const std::vector<std::string>& names, unsigned int n_of_replicates, unsigned int capacity){
+		this->Close();
+		this->fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (this->fd < 0) return false;
+
+		series_file_header_t header;
+		memcpy(header.magic, series_file_magic, sizeof(header.magic));
+		header.version = series_file_version;
+		header.n_of_metrics = names.size();
+		header.n_of_replicates = n_of_replicates;
+		header.capacity = capacity;
+		this->counts_offset = sizeof(header) + (uint64_t)names.size() * series_file_name_length;
+		header.data_offset = (this->counts_offset + (uint64_t)n_of_replicates * sizeof(uint32_t) + 63) / 64 * 64;
+		this->header = header;
+
+		std::vector<char> preamble(header.data_offset, 0);
+		memcpy(preamble.data(), &header, sizeof(header));
+		for (unsigned int m = 0; m < names.size(); ++m) {
+			strncpy(&preamble[sizeof(header) + m * series_file_name_length], names[m].c_str(), series_file_name_length - 1);
+		}
+		this->days.assign(n_of_replicates, 0);
+		this->buffers.assign(n_of_replicates, std::vector<double>((size_t)names.size() * series_file_block_days));
+		this->buffered_days.assign(n_of_replicates, 0);
+
+		// Columns are left sparse until written
+		const uint64_t size = header.data_offset + (uint64_t)n_of_replicates * names.size() * capacity * sizeof(double);
+		if (!this->WriteAt(preamble.data(), preamble.size(), 0) || ftruncate(this->fd, size) != 0) {
+			this->Close();
+			return false;
+		}
+		return true;
+	}
+
+	bool IsOpen() const { return this->fd >= 0; }
+
+	// Appends the next day of the replicate, values holds one value per metric
+	bool Append(unsigned int replicate, const double* values){
+		uint32_t& buffered = this->buffered_days[replicate];
+		if ((uint64_t)this->days[replicate] + buffered >= this->header.capacity) return false;
+		double* block = this->buffers[replicate].data();
+		for (unsigned int m = 0; m < this->header.n_of_metrics; ++m) block[m * series_file_block_days + buffered] = values[m];
+		++buffered;
+		return buffered < series_file_block_days || this->Flush(replicate);
+	}
+	template <class Values>
+	bool Append(unsigned int replicate, const Values& values){
+		return this->Append(replicate, values.data());
+	}
+
+	// Writes the buffered days and closes the file
+	void Close(){
+		if (this->fd >= 0) {
+			for (unsigned int r = 0; r < this->buffers.size(); ++r) this->Flush(r);
+			close(this->fd);
+		}
+		this->fd = -1;
+		this->buffers.clear();
+		this->buffered_days.clear();
+	}
+
+private:
+	int fd = -1;
+	series_file_header_t header;
+	uint64_t counts_offset = 0;
+	std::vector<uint32_t> days;
+	// Days of every replicate not written yet, a column of series_file_block_days values per metric
+	std::vector<std::vector<double>> buffers;
+	std::vector<uint32_t> buffered_days;
+
+	bool Flush(unsigned int replicate){
+		const uint32_t buffered = this->buffered_days[replicate];
+		if (!buffered) return true;
+		const double* block = this->buffers[replicate].data();
+		for (unsigned int m = 0; m < this->header.n_of_metrics; ++m) {
+			if (!this->WriteAt(&block[m * series_file_block_days], buffered * sizeof(double),
+							   this->ValueOffset(replicate, m, this->days[replicate]))) return false;
+		}
+		this->buffered_days[replicate] = 0;
+		return this->SetDays(replicate, this->days[replicate] + buffered);
+	}
+
+	uint64_t ValueOffset(unsigned int replicate, unsigned int metric, uint32_t day) const{
+		return this->header.data_offset
+			+ (((uint64_t)replicate * this->header.n_of_metrics + metric) * this->header.capacity + day) * sizeof(double);
+	}
+
+	bool SetDays(unsigned int replicate, uint32_t n_of_days){
+		this->days[replicate] = n_of_days;
+		return this->WriteAt(&n_of_days, sizeof(n_of_days), this->counts_offset + (uint64_t)replicate * sizeof(uint32_t));
+	}
+
+	bool WriteAt(const void* data, size_t size, uint64_t offset){
+		const char* bytes = (const char*)data;
+		while (size) {
+			const ssize_t written = pwrite(this->fd, bytes, size, offset);
+			if (written <= 0) return false;
+			bytes += written;
+			size -= written;
+			offset += written;
+		}
+		return true;
+	}
+};
+
+/* Memory maps a series file and hands out views of its columns without copying */
+class SeriesFileReader {
+public:
+	SeriesFileReader() = default;
+	SeriesFileReader(const SeriesFileReader&) = delete;
+	SeriesFileReader& operator=(const SeriesFileReader&) = delete;
+	~SeriesFileReader(){ this->Close(); }
+
+	// Returns false when the file can't be mapped or isn't a series file of a known version
+	bool Open(const std::string& filename){
+		this->Close();
+		const int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(series_file_header_t)) {
+			close(fd);
+			return false;
+		}
+		void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED) return false;
+		this->mapping = (const char*)mapping;
+		this->size = info.st_size;
+
+		const series_file_header_t& header = this->Header();
+		const uint64_t expected_size = header.data_offset
+			+ (uint64_t)header.n_of_replicates * header.n_of_metrics * header.capacity * sizeof(double);
+		if (memcmp(header.magic, series_file_magic, sizeof(header.magic)) != 0 || header.version != series_file_version
+				|| header.data_offset % 64 != 0 || this->size < expected_size) {
+			this->Close();
+			return false;
+		}
+		return true;
+	}
+
+	unsigned int Metrics() const { return this->Header().n_of_metrics; }
+
+	// Number of days of the replicate written so far
+	unsigned int Days(unsigned int replicate = 0) const{
+		uint32_t days;
+		memcpy(&days, this->mapping + sizeof(series_file_header_t) + this->Metrics() * series_file_name_length
+						  + replicate * sizeof(uint32_t), sizeof(days));
+		return days;
+	}
+
+	// All written days of the metric of the replicate
+	column_view_t Column(unsigned int metric, unsigned int replicate = 0) const{
+		const series_file_header_t& header = this->Header();
+		const double* values = (const double*)(this->mapping + header.data_offset)
+							   + ((uint64_t)replicate * header.n_of_metrics + metric) * header.capacity;
+		return {values, 0, std::min(this->Days(replicate), header.capacity)};
+	}
+
+	void Close(){
+		if (this->mapping) munmap((void*)this->mapping, this->size);
+		this->mapping = nullptr;
+		this->size = 0;
+	}
+
+private:
+	const char* mapping = nullptr;
+	size_t size = 0;
+
+	const series_file_header_t& Header() const{
+		return *(const series_file_header_t*)this->mapping;
+	}
+};
+
+#endif //IMS_SERIES_FILE_H
@@ -0,0 +1,70 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_SPSC_QUEUE_H
+#define IMS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/* Bounded lock free queue for exactly one producer thread and one consumer thread
+ * - Slots form a ring with a power of two size, head and tail only ever grow and are masked into it
+ * - Each side caches the other side's index and rereads it only when the ring looks full or empty,
+ *   so in the common case a push or a pop touches no cache line written by the other thread */
+template <class T>
+class SpscQueue {
+public:
+	explicit SpscQueue(size_t capacity){
+		size_t size = 1;
+		while (size < capacity) size <<= 1;
+		this->mask = size - 1;
+		this->slots.reset(new T[size]);
+	}
+
+	// Returns false when the queue is full, the item is left untouched then
+	bool TryPush(T& item){
+		const size_t tail = this->producer.tail.load(std::memory_order_relaxed);
+		if (tail - this->producer.cached_head > this->mask) {
+			this->producer.cached_head = this->consumer.head.load(std::memory_order_acquire);
+			if (tail - this->producer.cached_head > this->mask) return false;
+		}
+		this->slots[tail & this->mask] = std::move(item);
+		this->producer.tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false when the queue is empty
+	bool TryPop(T& item){
+		const size_t head = this->consumer.head.load(std::memory_order_relaxed);
+		if (head == this->consumer.cached_tail) {
+			this->consumer.cached_tail = this->producer.tail.load(std::memory_order_acquire);
+			if (head == this->consumer.cached_tail) return false;
+		}
+		item = std::move(this->slots[head & this->mask]);
+		this->consumer.head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	size_t mask;
+	std::unique_ptr<T[]> slots;
+	// Written by the producer only
+	struct alignas(64) {
+		std::atomic<size_t> tail{0};
+		size_t cached_head = 0;
+	} producer;
+	// Written by the consumer only
+	struct alignas(64) {
+		std::atomic<size_t> head{0};
+		size_t cached_tail = 0;
+	} consumer;
+};
+
+#endif //IMS_SPSC_QUEUE_H
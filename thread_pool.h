@@ -0,0 +1,208 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_THREAD_POOL_H
+#define IMS_THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of threads used for the requested number, 0 meaning all available cores
+inline unsigned int ThreadCount(unsigned int n_of_threads){
+	if (n_of_threads) return n_of_threads;
+	return std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+}
+
+/* Task indices handed out to a number of workers
+ * - Every worker starts with an equal contiguous share of the task indices and takes them from the front
+ * - A worker that runs out steals the back half of another worker's remaining share, so uneven task lengths balance out */
+class TaskShares {
+public:
+	TaskShares(unsigned int n_of_tasks, unsigned int n_of_workers) : n_of_workers(n_of_workers), shares(new share_t[n_of_workers]){
+		for (unsigned int w = 0; w < n_of_workers; ++w) {
+			this->shares[w].begin = (unsigned int)((uint64_t)n_of_tasks * w / n_of_workers);
+			this->shares[w].end = (unsigned int)((uint64_t)n_of_tasks * (w + 1) / n_of_workers);
+		}
+	}
+
+	// Runs task(i, worker_index) for the indices the worker gets until none are left
+	template <class Task>
+	void Work(unsigned int worker_index, const Task& task){
+		share_t& own = this->shares[worker_index];
+		while (true) {
+			unsigned int i = 0;
+			bool found = false;
+			{
+				std::lock_guard<std::mutex> guard(own.lock);
+				if (own.begin < own.end) {
+					i = own.begin++;
+					found = true;
+				}
+			}
+			if (found) {
+				task(i, worker_index);
+				continue;
+			}
+
+			// Own share is done, look for a victim with work left
+			for (unsigned int v = 1; v < this->n_of_workers && !found; ++v) {
+				share_t& victim = this->shares[(worker_index + v) % this->n_of_workers];
+				unsigned int stolen_begin, stolen_end;
+				{
+					std::lock_guard<std::mutex> guard(victim.lock);
+					if (victim.begin < victim.end) {
+						stolen_end = victim.end;
+						victim.end -= (victim.end - victim.begin + 1) / 2;
+						stolen_begin = victim.end;
+						found = true;
+					}
+				}
+				if (found) {
+					std::lock_guard<std::mutex> guard(own.lock);
+					own.begin = stolen_begin;
+					own.end = stolen_end;
+				}
+			}
+			// Everything left is being worked on by others
+			if (!found) return;
+		}
+	}
+
+private:
+	// Task indices [begin, end) not yet taken by anyone, one share per worker
+	struct alignas(64) share_t {
+		std::mutex lock;
+		unsigned int begin, end;
+	};
+	unsigned int n_of_workers;
+	std::unique_ptr<share_t[]> shares;
+};
+
+/* Runs task(i, worker) for every i from [0, n_of_tasks) on n_of_threads threads started for the call
+ * - The tasks are balanced by TaskShares
+ * - The worker index (below ThreadCount(n_of_threads)) lets tasks reuse per-thread scratch memory
+ * - Returns once all tasks are finished */
+template <class Task>
+void ParallelFor(unsigned int n_of_tasks, unsigned int n_of_threads, const Task& task){
+	n_of_threads = ThreadCount(n_of_threads);
+	if (n_of_threads > n_of_tasks) n_of_threads = n_of_tasks ? n_of_tasks : 1;
+
+	TaskShares shares(n_of_tasks, n_of_threads);
+	std::vector<std::thread> workers;
+	for (unsigned int w = 1; w < n_of_threads; ++w) {
+		workers.emplace_back([&shares, &task, w]{ shares.Work(w, task); });
+	}
+	shares.Work(0, task);
+	for (auto& thread : workers) {
+		thread.join();
+	}
+}
+
+/* Threads kept for as long as the pool lives, for loops run every simulated day
+ * - Run() behaves like ParallelFor on the pool's threads, the calling thread working as worker 0,
+ *   without starting and joining threads every time
+ * - One Run() at a time: the pool belongs to one model advancing on one thread */
+class WorkerPool {
+public:
+	explicit WorkerPool(unsigned int n_of_threads) : n_of_threads(ThreadCount(n_of_threads)){
+		for (unsigned int w = 1; w < this->n_of_threads; ++w) {
+			this->threads.emplace_back(&WorkerPool::Wait, this, w);
+		}
+	}
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool(){
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->stopping = true;
+		}
+		this->wake.notify_all();
+		for (auto& thread : this->threads) {
+			thread.join();
+		}
+	}
+
+	unsigned int Threads() const { return this->n_of_threads; }
+
+	template <class Task>
+	void Run(unsigned int n_of_tasks, const Task& task){
+		const unsigned int n_of_workers = std::max(std::min(this->n_of_threads, n_of_tasks), 1u);
+		TaskShares shares(n_of_tasks, n_of_workers);
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->job = [&shares, &task, n_of_workers](unsigned int worker_index){
+				if (worker_index < n_of_workers) shares.Work(worker_index, task);
+			};
+			this->busy = this->threads.size();
+			++this->generation;
+		}
+		this->wake.notify_all();
+		shares.Work(0, task);
+
+		std::unique_lock<std::mutex> guard(this->lock);
+		this->done.wait(guard, [this]{ return this->busy == 0; });
+		this->job = nullptr;
+	}
+
+private:
+	unsigned int n_of_threads;
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	// Job of the current Run(), its generation tells the threads it is a new one
+	std::function<void(unsigned int)> job;
+	uint64_t generation = 0;
+	unsigned int busy = 0;
+	bool stopping = false;
+
+	void Wait(unsigned int worker_index){
+		uint64_t seen = 0;
+		while (true) {
+			std::function<void(unsigned int)> job;
+			{
+				std::unique_lock<std::mutex> guard(this->lock);
+				this->wake.wait(guard, [&]{ return this->stopping || this->generation != seen; });
+				if (this->stopping) return;
+				seen = this->generation;
+				job = this->job;
+			}
+			job(worker_index);
+			{
+				std::lock_guard<std::mutex> guard(this->lock);
+				if (--this->busy == 0) this->done.notify_one();
+			}
+		}
+	}
+};
+
+/* WorkerPool of a copyable model, started on first use
+ * - A copy starts without threads, so copies of a model advancing concurrently never share a pool
+ * - Get() restarts the pool when asked for a different number of threads */
+class LazyWorkerPool {
+public:
+	LazyWorkerPool() = default;
+	LazyWorkerPool(const LazyWorkerPool&){}
+	LazyWorkerPool& operator=(const LazyWorkerPool&){ return *this; }
+
+	WorkerPool& Get(unsigned int n_of_threads){
+		n_of_threads = ThreadCount(n_of_threads);
+		if (!this->pool || this->pool->Threads() != n_of_threads) this->pool.reset(new WorkerPool(n_of_threads));
+		return *this->pool;
+	}
+
+private:
+	std::unique_ptr<WorkerPool> pool;
+};
+
+#endif //IMS_THREAD_POOL_H
@@ -0,0 +1,117 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_TIMESERIES_H
+#define IMS_TIMESERIES_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+/* Read only view of consecutive days of one metric, pointing into a TimeSeriesStore
+ * - Stays valid until the store grows past its capacity or is destroyed */
+struct column_view_t {
+	const double* values;
+	unsigned int first_day, n_of_days;
+
+	const double* begin() const { return this->values; }
+	const double* end() const { return this->values + this->n_of_days; }
+	unsigned int size() const { return this->n_of_days; }
+	// Value on the i-th day of the view (day first_day + i of the store)
+	double operator[](unsigned int i) const { return this->values[i]; }
+};
+
+/* Daily values of a fixed set of metrics stored column by column
+ * - Every metric has one contiguous column preallocated for the expected number of days
+ * - Days are only appended, Clear() forgets them but keeps the memory, so one store serves many replicates
+ * - Days are indexed from 0, queries return views into the columns instead of copies */
+class TimeSeriesStore {
+public:
+	TimeSeriesStore(unsigned int n_of_metrics, unsigned int capacity)
+		: n_of_metrics(n_of_metrics), capacity(std::max(capacity, 1u)), n_of_days(0),
+		  columns((size_t)n_of_metrics * std::max(capacity, 1u), 0.0) {}
+
+	unsigned int Metrics() const { return this->n_of_metrics; }
+	unsigned int Days() const { return this->n_of_days; }
+
+	void Clear(){
+		this->n_of_days = 0;
+	}
+
+	// Appends the next day, values holds one value per metric
+	void Append(const double* values){
+		if (this->n_of_days == this->capacity) this->Reserve(2 * this->capacity);
+		for (unsigned int m = 0; m < this->n_of_metrics; ++m) {
+			this->columns[(size_t)m * this->capacity + this->n_of_days] = values[m];
+		}
+		++this->n_of_days;
+	}
+	template <class Values>
+	void Append(const Values& values){
+		this->Append(values.data());
+	}
+
+	double At(unsigned int metric, unsigned int day) const{
+		return this->columns[(size_t)metric * this->capacity + day];
+	}
+
+	// All stored days of the metric
+	column_view_t Column(unsigned int metric) const{
+		return this->Column(metric, 0, this->n_of_days);
+	}
+	// Days [first_day, last_day) of the metric, clamped to the stored days
+	column_view_t Column(unsigned int metric, unsigned int first_day, unsigned int last_day) const{
+		last_day = std::min(last_day, this->n_of_days);
+		first_day = std::min(first_day, last_day);
+		return {this->columns.data() + (size_t)metric * this->capacity + first_day, first_day, last_day - first_day};
+	}
+
+	// Makes room for the given number of days without moving the columns again
+	void Reserve(unsigned int days){
+		if (days <= this->capacity) return;
+		std::vector<double> grown((size_t)this->n_of_metrics * days, 0.0);
+		for (unsigned int m = 0; m < this->n_of_metrics; ++m) {
+			std::copy_n(this->columns.data() + (size_t)m * this->capacity, this->n_of_days, grown.data() + (size_t)m * days);
+		}
+		this->columns.swap(grown);
+		this->capacity = days;
+	}
+
+private:
+	unsigned int n_of_metrics, capacity, n_of_days;
+	// Metric m occupies [m * capacity, (m + 1) * capacity)
+	std::vector<double> columns;
+};
+
+/* Series continuing a prefix of days shared with other series (copy on write)
+ * - The prefix is immutable and reference counted, a fork only stores the days appended to it,
+ *   so any number of forks of one prefix keep a single copy of it */
+class ForkedTimeSeries {
+public:
+	ForkedTimeSeries(std::shared_ptr<const TimeSeriesStore> prefix, unsigned int capacity)
+		: prefix(prefix), own(prefix->Metrics(), capacity) {}
+
+	unsigned int Metrics() const { return this->own.Metrics(); }
+	unsigned int Days() const { return this->prefix->Days() + this->own.Days(); }
+
+	template <class Values>
+	void Append(const Values& values){
+		this->own.Append(values);
+	}
+
+	double At(unsigned int metric, unsigned int day) const{
+		const unsigned int shared_days = this->prefix->Days();
+		return day < shared_days ? this->prefix->At(metric, day) : this->own.At(metric, day - shared_days);
+	}
+
+private:
+	std::shared_ptr<const TimeSeriesStore> prefix;
+	TimeSeriesStore own;
+};
+
+#endif //IMS_TIMESERIES_H
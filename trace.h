@@ -0,0 +1,58 @@
+/**********************************************
+ *                 IMS Project                *
+ *                                            *
+ *   Epidemiological macro model simulation   *
+ *         Martin Škorupa  (xskoru00)         *
+ *          Diana Barnová  (xbarno00)         *
+ **********************************************/
+
+#ifndef IMS_TRACE_H
+#define IMS_TRACE_H
+
+#include <cstdint>
+
+#include "rng.h"
+
+/* Compile time tracing of the simulation events
+ * - Which phases are traced is a template parameter, so untraced phases contain no trace code or branches at all
+ * - Phases are the ones of phase_t, setup standing for the settings and the day headers and reports
+ * - IMS_TRACE selects the phases of the default build as a mask with bit (1 << phase) per phase, e.g.
+ *   -DIMS_TRACE=0x3f traces everything and -DIMS_TRACE=0x10 only the hospital (H|) events
+ * - IMS_EVENTS selects the phases recording binary events (see events.h) with the same kind of mask
+ * - Traced statements write into cout from the simulating thread, so main runs a tracing build on a single thread */
+
+#ifndef IMS_TRACE
+#define IMS_TRACE 0
+#endif
+#ifndef IMS_EVENTS
+#define IMS_EVENTS 0
+#endif
+
+template <uint32_t Phases, uint32_t EventPhases = 0>
+struct Trace {
+	static constexpr bool Enabled(phase_t phase){
+		return (Phases >> (uint32_t)phase) & 1u;
+	}
+	static constexpr bool Any(){
+		return Phases != 0;
+	}
+	static constexpr bool Records(phase_t phase){
+		return (EventPhases >> (uint32_t)phase) & 1u;
+	}
+	static constexpr bool RecordsAny(){
+		return EventPhases != 0;
+	}
+};
+
+typedef Trace<IMS_TRACE, IMS_EVENTS> DefaultTrace;
+
+// Policy used by TRACE outside of classes templated on their own one
+typedef DefaultTrace Tracing;
+
+/* Runs msg (statements writing to cout) when the phase is traced by the policy named Tracing in scope
+ * - Inside a class template with a Tracing parameter that parameter is used, elsewhere DefaultTrace */
+#define TRACE(phase, msg) do { \
+  if constexpr (Tracing::Enabled(phase)) { msg } \
+} while (0)
+
+#endif //IMS_TRACE_H